@@ -2,6 +2,12 @@
   'variables': {
     'steamworks_sdk_dir': '<!(node tools/steamworks_sdk_dir.js)',
     'discord_game_sdk_dir': '<!(node tools/discord_game_sdk_dir.js)',
+    # Set to 1 to build the background Steam callback dispatcher, which needs
+    # v1.48 of the Steamworks SDK or later.
+    'steam_manual_dispatch%': 0,
+    # Set to 1 to also build the archive_benchmark executable, which measures
+    # zip() and unzip() without Steam, see test/archive_benchmark.cc.
+    'archive_benchmark%': 0,
   },
 
   'conditions': [
@@ -77,6 +83,60 @@
         }],
       ],
     }],
+    ['archive_benchmark==1', {
+      'targets': [
+        {
+          'target_name': 'archive_benchmark',
+          'type': 'executable',
+          'sources': [
+            'src/greenworks_archive_progress.cc',
+            'src/greenworks_archive_progress.h',
+            'src/greenworks_batch_writer.cc',
+            'src/greenworks_batch_writer.h',
+            'src/greenworks_file_pipeline.cc',
+            'src/greenworks_file_pipeline.h',
+            'src/greenworks_memory_file.cc',
+            'src/greenworks_memory_file.h',
+            'src/greenworks_unzip.cc',
+            'src/greenworks_unzip.h',
+            'src/greenworks_zip.cc',
+            'src/greenworks_zip.h',
+            'test/archive_benchmark.cc',
+          ],
+          'include_dirs': [
+            'deps',
+            'src',
+          ],
+          'dependencies': [ 'deps/zlib/zlib.gyp:minizip' ],
+          'cflags': [ '-std=c++14' ],
+          'conditions': [
+            ['OS=="linux"', {
+              'libraries': [ '-lpthread' ],
+            }],
+            ['OS=="win"', {
+              'libraries': [ '-lpsapi' ],
+            }],
+            ['OS=="mac" or OS=="ios" or OS=="android"', {
+              'defines': [
+                'USE_FILE32API'
+              ],
+            }],
+          ],
+          'xcode_settings': {
+            'OTHER_CPLUSPLUSFLAGS' : [
+              '-std=c++14',
+              '-stdlib=libc++'
+            ],
+            'OTHER_LDFLAGS': [
+              '-stdlib=libc++'
+            ],
+          },
+          'msvs_disabled_warnings': [
+            4267,  # conversion from 'size_t' to 'int', possible loss of data
+          ],
+        },
+      ],
+    }],
   ],
 
   'targets': [
@@ -111,8 +171,18 @@
         'src/api/steam_api_workshop.cc',
         'src/api/discord_api.cc',
         'src/greenworks_api.cc',
+        'src/greenworks_archive_handle.cc',
+        'src/greenworks_archive_handle.h',
+        'src/greenworks_archive_progress.cc',
+        'src/greenworks_archive_progress.h',
         'src/greenworks_async_workers.cc',
         'src/greenworks_async_workers.h',
+        'src/greenworks_batch_writer.cc',
+        'src/greenworks_batch_writer.h',
+        'src/greenworks_file_pipeline.cc',
+        'src/greenworks_file_pipeline.h',
+        'src/greenworks_memory_file.cc',
+        'src/greenworks_memory_file.h',
         'src/greenworks_unzip.cc',
         'src/greenworks_unzip.h',
         'src/greenworks_utils.cc',
@@ -126,6 +196,8 @@
         'src/steam_async_worker.h',
         'src/steam_client.cc',
         'src/steam_client.h',
+        'src/steam_dispatcher.cc',
+        'src/steam_dispatcher.h',
         'src/steam_event.cc',
         'src/steam_event.h',
         'src/steam_id.cc',
@@ -173,6 +245,13 @@
             ],
           },
         ],
+        ['steam_manual_dispatch==1',
+          {
+            'defines': [
+              'GREENWORKS_MANUAL_DISPATCH',
+            ],
+          },
+        ],
         ['OS== "win" and target_arch=="x64"',
           {
             'defines': [
@@ -204,7 +283,7 @@
       },
       'msvs_disabled_warnings': [
         4068,  # disable unknown pragma warnings from nw.js custom node_buffer.h.
-        4267,  # conversion from 'size_t' to 'int', popssible loss of data
+        4267,  # conversion from 'size_t' to 'int', possible loss of data
       ],
     },
     {
@@ -1781,9 +1781,11 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uDoCopy;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
-                                pfile_in_zip_read_info->stream.next_out,
-                                uDoCopy);
+            /* The CRC covers uncompressed data and isn't checked in raw mode. */
+            if (!pfile_in_zip_read_info->raw)
+                pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+                                    pfile_in_zip_read_info->stream.next_out,
+                                    uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
             pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
             pfile_in_zip_read_info->stream.avail_out -= uDoCopy;
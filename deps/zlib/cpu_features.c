@@ -0,0 +1,71 @@
+/* cpu_features.c -- Processor features detection.
+ *
+ * Copyright 2018 The Chromium Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the Chromium source repository LICENSE file.
+ */
+
+#include "cpu_features.h"
+
+/* SSE4.2 and PCLMULQDQ, as needed by crc32_sse42_simd_(). */
+int ZLIB_INTERNAL x86_cpu_enable_simd = 0;
+
+#if defined(CRC32_SIMD_SSE42_PCLMUL)
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  include <windows.h>
+#else
+#  include <cpuid.h>
+#  include <pthread.h>
+#endif
+
+local void _cpu_check_features(void)
+{
+    unsigned int regs[4] = {0, 0, 0, 0};
+    int x86_cpu_has_sse42;
+    int x86_cpu_has_pclmulqdq;
+
+#if defined(_MSC_VER)
+    __cpuid((int*)regs, 1);
+#else
+    if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+        return;
+#endif
+
+    x86_cpu_has_sse42 = regs[2] & (1 << 20);
+    x86_cpu_has_pclmulqdq = regs[2] & (1 << 1);
+    x86_cpu_enable_simd = x86_cpu_has_sse42 && x86_cpu_has_pclmulqdq;
+}
+
+#if defined(_MSC_VER)
+static INIT_ONCE cpu_check_inited_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK _cpu_check_features_forwarder(PINIT_ONCE once,
+                                                   PVOID param, PVOID* context)
+{
+    _cpu_check_features();
+    return TRUE;
+}
+
+void ZLIB_INTERNAL cpu_check_features(void)
+{
+    InitOnceExecuteOnce(&cpu_check_inited_once, _cpu_check_features_forwarder,
+                        NULL, NULL);
+}
+#else
+static pthread_once_t cpu_check_inited_once = PTHREAD_ONCE_INIT;
+
+void ZLIB_INTERNAL cpu_check_features(void)
+{
+    pthread_once(&cpu_check_inited_once, _cpu_check_features);
+}
+#endif
+
+#else  /* !CRC32_SIMD_SSE42_PCLMUL */
+
+void ZLIB_INTERNAL cpu_check_features(void)
+{
+}
+
+#endif  /* CRC32_SIMD_SSE42_PCLMUL */
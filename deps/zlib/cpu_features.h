@@ -0,0 +1,33 @@
+/* cpu_features.h -- Processor features detection.
+ *
+ * Copyright 2018 The Chromium Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the Chromium source repository LICENSE file.
+ */
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+#include "zutil.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#  define X86_CPU_FEATURES
+#endif
+
+#if defined(X86_CPU_FEATURES) && !defined(ZLIB_NO_SIMD)
+/* crc32_simd.c is only built for compilers that can target PCLMUL per
+   function, so that the rest of zlib still runs on any x86 processor. */
+#  if defined(_MSC_VER) || defined(__clang__) || \
+      (defined(__GNUC__) && (__GNUC__ > 4 || \
+                             (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#    define CRC32_SIMD_SSE42_PCLMUL
+#  endif
+#endif
+
+/* Set by cpu_check_features(). */
+extern int ZLIB_INTERNAL x86_cpu_enable_simd;
+
+/* Detects the processor features once; safe to call from any thread. */
+void ZLIB_INTERNAL cpu_check_features(void);
+
+#endif  /* CPU_FEATURES_H_ */
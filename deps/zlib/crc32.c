@@ -27,6 +27,7 @@
 #endif /* MAKECRCH */
 
 #include "zutil.h"      /* for STDC and FAR definitions */
+#include "crc32_simd.h" /* Greenworks: PCLMUL crc32 */
 
 #define local static
 
@@ -230,6 +231,22 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         make_crc_table();
 #endif /* DYNAMIC_CRC_TABLE */
 
+#if defined(CRC32_SIMD_SSE42_PCLMUL)
+    /* Greenworks: fold 16 byte blocks with PCLMULQDQ where available; the
+       tables below handle the tail and older processors. */
+    if (len >= Z_CRC32_SSE42_MINIMUM_LENGTH) {
+        cpu_check_features();
+        if (x86_cpu_enable_simd) {
+            uInt chunk_size = len & ~Z_CRC32_SSE42_CHUNKSIZE_MASK;
+            crc = crc32_sse42_simd_(buf, chunk_size, crc ^ 0xffffffffUL) ^
+                  0xffffffffUL;
+            len -= chunk_size;
+            buf += chunk_size;
+            if (!len) return crc;
+        }
+    }
+#endif
+
 #ifdef BYFOUR
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
         u4 endian;
@@ -0,0 +1,27 @@
+/* crc32_simd.h
+ *
+ * Copyright 2017 The Chromium Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the Chromium source repository LICENSE file.
+ */
+#ifndef CRC32_SIMD_H_
+#define CRC32_SIMD_H_
+
+#include "cpu_features.h"
+
+#if defined(CRC32_SIMD_SSE42_PCLMUL)
+
+/*
+ * crc32_sse42_simd_(): compute the crc32 of the buffer, where the buffer
+ * length must be at least 64, and a multiple of 16. The crc is passed in
+ * and returned without the pre and post conditioning of crc32().
+ */
+unsigned long ZLIB_INTERNAL crc32_sse42_simd_(const unsigned char *buf,
+                                              uInt len, unsigned long crc);
+
+#define Z_CRC32_SSE42_MINIMUM_LENGTH 64
+#define Z_CRC32_SSE42_CHUNKSIZE_MASK 15
+
+#endif  /* CRC32_SIMD_SSE42_PCLMUL */
+
+#endif  /* CRC32_SIMD_H_ */
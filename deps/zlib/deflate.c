@@ -1435,6 +1435,27 @@ local void check_match(s, start, match, length)
 #  define check_match(s, start, match, length)
 #endif /* DEBUG */
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+/* Greenworks: SSE2 is part of every x86-64 processor, so this needs no
+ * runtime check. A saturating subtract turns positions below wsize into NIL
+ * and moves the others down, eight at a time. |n| is a power of two of at
+ * least 256.
+ */
+#include <emmintrin.h>
+#define SLIDE_HASH_SSE2
+
+local void slide_hash_sse2(Posf *table, unsigned n, uInt wsize)
+{
+    const __m128i xmm_wsize = _mm_set1_epi16((short)wsize);
+    __m128i *p = (__m128i *)table;
+    __m128i *end = (__m128i *)(table + n);
+    Assert(sizeof(Pos) == 2, "Pos must be 16 bits");
+    for (; p < end; p++)
+        _mm_storeu_si128(p, _mm_subs_epu16(_mm_loadu_si128(p), xmm_wsize));
+}
+#endif
+
 /* ===========================================================================
  * Fill the window when the lookahead becomes insufficient.
  * Updates strstart and lookahead.
@@ -1448,8 +1469,11 @@ local void check_match(s, start, match, length)
 local void fill_window(s)
     deflate_state *s;
 {
-    register unsigned n, m;
+    register unsigned n;
+#ifndef SLIDE_HASH_SSE2
+    register unsigned m;
     register Posf *p;
+#endif
     unsigned more;    /* Amount of free space at the end of the window. */
     uInt wsize = s->w_size;
 
@@ -1485,6 +1509,12 @@ local void fill_window(s)
                later. (Using level 0 permanently is not an optimal usage of
                zlib, so we don't care about this pathological case.)
              */
+#ifdef SLIDE_HASH_SSE2
+            slide_hash_sse2(s->head, s->hash_size, wsize);
+#ifndef FASTEST
+            slide_hash_sse2(s->prev, wsize, wsize);
+#endif
+#else
             n = s->hash_size;
             p = &s->head[n];
             do {
@@ -1503,6 +1533,7 @@ local void fill_window(s)
                  */
             } while (--n);
 #endif
+#endif /* SLIDE_HASH_SSE2 */
 
             for (n = 0; n < Z_COOKIE_HASH_SIZE; n++) {
                 if (s->cookie_locations[n] > wsize) {
@@ -29,6 +29,44 @@
 #  define PUP(a) *++(a)
 #endif
 
+/* Greenworks: copies |len| bytes starting |dist| bytes back in the output,
+   where |dist| >= 8, a chunk at a time instead of a byte at a time. A chunk
+   never reads bytes it writes, so it can go through memcpy(), which
+   compilers turn into a single unaligned load and store. Writes exactly
+   |len| bytes and returns the updated |out|. */
+local unsigned char FAR *chunk_copy(unsigned char FAR *out, unsigned dist,
+                                    unsigned len)
+{
+    unsigned char FAR *to = out + OFF;
+
+    if (dist >= 16) {
+        while (len >= 16) {
+            zmemcpy(to, to - dist, 16);
+            to += 16;
+            len -= 16;
+        }
+    }
+    while (len >= 8) {
+        zmemcpy(to, to - dist, 8);
+        to += 8;
+        len -= 8;
+    }
+    while (len--) {
+        *to = *(to - dist);
+        to++;
+    }
+    return to - OFF;
+}
+
+/* Greenworks: copies |len| bytes from the window, which never overlaps the
+   output. */
+#define WINDOW_COPY(len) \
+    do { \
+        zmemcpy(out + OFF, from + OFF, (len)); \
+        out += (len); \
+        from += (len); \
+    } while (0)
+
 /*
    Decode literal, length, and distance codes and write out the resulting
    literal and match bytes until either not enough input or output is
@@ -218,9 +256,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                         from += wsize - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            WINDOW_COPY(op);
                             from = out - dist;  /* rest from output */
                         }
                     }
@@ -229,16 +265,12 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                         op -= wnext;
                         if (op < len) {         /* some from end of window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            WINDOW_COPY(op);
                             from = window - OFF;
                             if (wnext < len) {  /* some from start of window */
                                 op = wnext;
                                 len -= op;
-                                do {
-                                    PUP(out) = PUP(from);
-                                } while (--op);
+                                WINDOW_COPY(op);
                                 from = out - dist;      /* rest from output */
                             }
                         }
@@ -247,9 +279,7 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                         from += wnext - op;
                         if (op < len) {         /* some from window */
                             len -= op;
-                            do {
-                                PUP(out) = PUP(from);
-                            } while (--op);
+                            WINDOW_COPY(op);
                             from = out - dist;  /* rest from output */
                         }
                     }
@@ -265,6 +295,9 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
                             PUP(out) = PUP(from);
                     }
                 }
+                else if (dist >= 8) {
+                    out = chunk_copy(out, dist, len);
+                }
                 else {
                     from = out - dist;          /* copy direct from output */
                     do {                        /* minimum length is three */
@@ -10,8 +10,12 @@
       'sources': [
         'adler32.c',
         'compress.c',
+        'cpu_features.c',
+        'cpu_features.h',
         'crc32.c',
         'crc32.h',
+        'crc32_simd.c',
+        'crc32_simd.h',
         'deflate.c',
         'deflate.h',
         'gzclose.c',
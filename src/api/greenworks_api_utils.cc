@@ -2,11 +2,15 @@
 // Use of this source code is governed by the MIT license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <thread>
 
 #include "nan.h"
 #include "v8.h"
 
+#include "greenworks_archive_handle.h"
 #include "greenworks_async_workers.h"
 #include "steam_api_registry.h"
 
@@ -14,10 +18,76 @@ namespace greenworks {
 namespace api {
 namespace {
 
+// Reads the `threads` property of an archive options object, leaving
+// |threads| as is if it isn't set. Returns false if it isn't valid. More
+// threads than CPU cores are capped, as failing to start a thread on a
+// worker would terminate the process.
+bool GetThreadsOption(v8::Local<v8::Value> options, int* threads) {
+  v8::Local<v8::Value> value =
+      Nan::Get(Nan::To<v8::Object>(options).ToLocalChecked(),
+               Nan::New("threads").ToLocalChecked())
+          .ToLocalChecked();
+  if (value->IsUndefined())
+    return true;
+  if (!value->IsUint32())
+    return false;
+  uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  *threads = static_cast<int>(
+      std::min(Nan::To<uint32_t>(value).FromJust(), max_threads));
+  return true;
+}
+
+// Reads the string property |name| of an options object, leaving |result|
+// as is if it isn't set. Returns false if it isn't a string.
+bool GetStringOption(v8::Local<v8::Value> options, const char* name,
+                     std::string* result) {
+  v8::Local<v8::Value> value =
+      Nan::Get(Nan::To<v8::Object>(options).ToLocalChecked(),
+               Nan::New(name).ToLocalChecked())
+          .ToLocalChecked();
+  if (value->IsUndefined())
+    return true;
+  if (!value->IsString())
+    return false;
+  *result = *(Nan::Utf8String(value));
+  return true;
+}
+
+// Reads the boolean property |name| of an options object, false if it isn't
+// set.
+bool GetBoolOption(v8::Local<v8::Value> options, const char* name) {
+  v8::Local<v8::Value> value =
+      Nan::Get(Nan::To<v8::Object>(options).ToLocalChecked(),
+               Nan::New(name).ToLocalChecked())
+          .ToLocalChecked();
+  return Nan::To<bool>(value).FromJust();
+}
+
+// Reads the function property |name| of an options object into |callback|,
+// leaving it null if it isn't set. Returns false if it isn't a function.
+bool GetCallbackOption(v8::Local<v8::Value> options, const char* name,
+                       Nan::Callback** callback) {
+  v8::Local<v8::Value> value =
+      Nan::Get(Nan::To<v8::Object>(options).ToLocalChecked(),
+               Nan::New(name).ToLocalChecked())
+          .ToLocalChecked();
+  if (value->IsUndefined())
+    return true;
+  if (!value->IsFunction())
+    return false;
+  *callback = new Nan::Callback(value.As<v8::Function>());
+  return true;
+}
+
 NAN_METHOD(CreateArchive) {
   Nan::HandleScope scope;
-  if (info.Length() < 5 || !info[0]->IsString() || !info[1]->IsString() ||
-      !info[2]->IsString() || !info[3]->IsInt32() || !info[4]->IsFunction()) {
+  // The options object is optional and comes before the callbacks.
+  int callback_index = 4;
+  if (info.Length() > 4 && info[4]->IsObject() && !info[4]->IsFunction())
+    callback_index = 5;
+  if (info.Length() <= callback_index || !info[0]->IsString() ||
+      !info[1]->IsString() || !info[2]->IsString() || !info[3]->IsInt32() ||
+      !info[callback_index]->IsFunction()) {
     THROW_BAD_ARGS("bad arguments");
   }
   std::string zip_file_path = *(Nan::Utf8String(info[0]));
@@ -25,38 +95,296 @@ NAN_METHOD(CreateArchive) {
   std::string password = *(Nan::Utf8String(info[2]));
   int compress_level = Nan::To<int>(info[3]).FromJust();
 
+  int threads = 1;
+  if (callback_index == 5 && !GetThreadsOption(info[4], &threads))
+    THROW_BAD_ARGS("'threads' must be a non-negative integer.");
+  std::string previous_archive;
+  if (callback_index == 5 &&
+      !GetStringOption(info[4], "previous_archive", &previous_archive)) {
+    THROW_BAD_ARGS("'previous_archive' must be a string.");
+  }
+  bool store_incompressible =
+      callback_index == 5 && GetBoolOption(info[4], "store_incompressible");
+  Nan::Callback* progress_callback = nullptr;
+  if (callback_index == 5 &&
+      !GetCallbackOption(info[4], "progress", &progress_callback)) {
+    THROW_BAD_ARGS("'progress' must be a function.");
+  }
+
   Nan::Callback* success_callback =
-      new Nan::Callback(info[4].As<v8::Function>());
+      new Nan::Callback(info[callback_index].As<v8::Function>());
   Nan::Callback* error_callback = nullptr;
 
-  if (info.Length() > 5 && info[5]->IsFunction())
-    error_callback = new Nan::Callback(info[5].As<v8::Function>());
+  if (info.Length() > callback_index + 1 &&
+      info[callback_index + 1]->IsFunction()) {
+    error_callback =
+        new Nan::Callback(info[callback_index + 1].As<v8::Function>());
+  }
 
-  Nan::AsyncQueueWorker(new greenworks::CreateArchiveWorker(
-      success_callback, error_callback, zip_file_path, source_dir, password,
-      compress_level));
-  info.GetReturnValue().Set(Nan::Undefined());
+  auto* worker = new greenworks::CreateArchiveWorker(
+      success_callback, error_callback, progress_callback, zip_file_path,
+      source_dir, password, compress_level, threads, previous_archive,
+      store_incompressible);
+  info.GetReturnValue().Set(
+      greenworks::ArchiveCancelHandle::Create(worker->progress()));
+  Nan::AsyncQueueWorker(worker);
 }
 
 NAN_METHOD(ExtractArchive) {
   Nan::HandleScope scope;
-  if (info.Length() < 4 || !info[0]->IsString() || !info[1]->IsString() ||
-      !info[2]->IsString() || !info[3]->IsFunction()) {
+  // The options object is optional and comes before the callbacks.
+  int callback_index = 3;
+  if (info.Length() > 3 && info[3]->IsObject() && !info[3]->IsFunction())
+    callback_index = 4;
+  if (info.Length() <= callback_index || !info[0]->IsString() ||
+      !info[1]->IsString() || !info[2]->IsString() ||
+      !info[callback_index]->IsFunction()) {
     THROW_BAD_ARGS("bad arguments");
   }
   std::string zip_file_path = *(Nan::Utf8String(info[0]));
   std::string extract_dir = *(Nan::Utf8String(info[1]));
   std::string password = *(Nan::Utf8String(info[2]));
 
+  int threads = 1;
+  if (callback_index == 4 && !GetThreadsOption(info[3], &threads))
+    THROW_BAD_ARGS("'threads' must be a non-negative integer.");
+  bool skip_unchanged = false;
+  bool verify_crc = false;
+  std::string journal;
+  bool deduplicate = false;
+  bool hardlink_duplicates = false;
+  bool verify_duplicates = false;
+  if (callback_index == 4) {
+    skip_unchanged = GetBoolOption(info[3], "skip_unchanged");
+    verify_crc = GetBoolOption(info[3], "verify_crc");
+    if (!GetStringOption(info[3], "journal", &journal))
+      THROW_BAD_ARGS("'journal' must be a string.");
+    deduplicate = GetBoolOption(info[3], "deduplicate");
+    hardlink_duplicates = GetBoolOption(info[3], "hardlink_duplicates");
+    verify_duplicates = GetBoolOption(info[3], "verify_duplicates");
+  }
+  Nan::Callback* progress_callback = nullptr;
+  if (callback_index == 4 &&
+      !GetCallbackOption(info[3], "progress", &progress_callback)) {
+    THROW_BAD_ARGS("'progress' must be a function.");
+  }
+
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[callback_index].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > callback_index + 1 &&
+      info[callback_index + 1]->IsFunction()) {
+    error_callback =
+        new Nan::Callback(info[callback_index + 1].As<v8::Function>());
+  }
+
+  auto* worker = new greenworks::ExtractArchiveWorker(
+      success_callback, error_callback, progress_callback, zip_file_path,
+      extract_dir, password, threads, skip_unchanged, verify_crc, journal,
+      deduplicate, hardlink_duplicates, verify_duplicates);
+  info.GetReturnValue().Set(
+      greenworks::ArchiveCancelHandle::Create(worker->progress()));
+  Nan::AsyncQueueWorker(worker);
+}
+
+NAN_METHOD(CreateArchiveToBuffer) {
+  Nan::HandleScope scope;
+  // The options object is optional and comes before the callbacks.
+  int callback_index = 3;
+  if (info.Length() > 3 && info[3]->IsObject() && !info[3]->IsFunction())
+    callback_index = 4;
+  if (info.Length() <= callback_index ||
+      !(info[0]->IsString() || info[0]->IsArray()) || !info[1]->IsString() ||
+      !info[2]->IsInt32() || !info[callback_index]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::string password = *(Nan::Utf8String(info[1]));
+  int compress_level = Nan::To<int>(info[2]).FromJust();
+
+  int threads = 1;
+  if (callback_index == 4 && !GetThreadsOption(info[3], &threads))
+    THROW_BAD_ARGS("'threads' must be a non-negative integer.");
+
+  std::string source_dir;
+  if (info[0]->IsString()) {
+    source_dir = *(Nan::Utf8String(info[0]));
+    if (source_dir.empty())
+      THROW_BAD_ARGS("bad arguments");
+  }
+
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[callback_index].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > callback_index + 1 &&
+      info[callback_index + 1]->IsFunction()) {
+    error_callback =
+        new Nan::Callback(info[callback_index + 1].As<v8::Function>());
+  }
+
+  auto* worker = new greenworks::CreateArchiveToBufferWorker(
+      success_callback, error_callback, source_dir, password, compress_level,
+      threads);
+  if (info[0]->IsArray()) {
+    v8::Local<v8::Array> entries = info[0].As<v8::Array>();
+    for (uint32_t i = 0; i < entries->Length(); ++i) {
+      v8::Local<v8::Value> entry = Nan::Get(entries, i).ToLocalChecked();
+      v8::Local<v8::Value> name;
+      v8::Local<v8::Value> data;
+      if (entry->IsObject()) {
+        v8::Local<v8::Object> object = entry.As<v8::Object>();
+        name = Nan::Get(object, Nan::New("name").ToLocalChecked())
+                   .ToLocalChecked();
+        data = Nan::Get(object, Nan::New("data").ToLocalChecked())
+                   .ToLocalChecked();
+      }
+      if (name.IsEmpty() || !name->IsString() ||
+          !(data->IsString() || node::Buffer::HasInstance(data))) {
+        delete worker;
+        THROW_BAD_ARGS("Entries must be {name: String, data: Buffer|String}.");
+      }
+      if (data->IsString()) {
+        Nan::Utf8String text(data);
+        data = Nan::CopyBuffer(*text, text.length()).ToLocalChecked();
+      }
+      // The worker reads the Buffer on another thread, so keep it alive.
+      worker->SaveToPersistent(i, data);
+      worker->AddEntry(*(Nan::Utf8String(name)), node::Buffer::Data(data),
+                       node::Buffer::Length(data));
+    }
+  }
+
+  Nan::AsyncQueueWorker(worker);
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(ExtractArchiveFromBuffer) {
+  Nan::HandleScope scope;
+  // The options object is optional and comes before the callbacks.
+  int callback_index = 2;
+  if (info.Length() > 2 && info[2]->IsObject() && !info[2]->IsFunction())
+    callback_index = 3;
+  if (info.Length() <= callback_index ||
+      !node::Buffer::HasInstance(info[0]) || !info[1]->IsString() ||
+      !info[callback_index]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::string password = *(Nan::Utf8String(info[1]));
+
+  int threads = 1;
+  if (callback_index == 3 && !GetThreadsOption(info[2], &threads))
+    THROW_BAD_ARGS("'threads' must be a non-negative integer.");
+
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[callback_index].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > callback_index + 1 &&
+      info[callback_index + 1]->IsFunction()) {
+    error_callback =
+        new Nan::Callback(info[callback_index + 1].As<v8::Function>());
+  }
+
+  auto* worker = new greenworks::ExtractArchiveFromBufferWorker(
+      success_callback, error_callback, node::Buffer::Data(info[0]),
+      node::Buffer::Length(info[0]), password, threads);
+  // The worker reads the Buffer on another thread, so keep it alive.
+  worker->SaveToPersistent("archive", info[0]);
+  Nan::AsyncQueueWorker(worker);
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(ListArchive) {
+  Nan::HandleScope scope;
+  if (info.Length() < 2 || !info[0]->IsString() || !info[1]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::string zip_file_path = *(Nan::Utf8String(info[0]));
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[1].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > 2 && info[2]->IsFunction())
+    error_callback = new Nan::Callback(info[2].As<v8::Function>());
+
+  Nan::AsyncQueueWorker(new greenworks::ListArchiveWorker(
+      success_callback, error_callback, zip_file_path));
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(VerifyArchive) {
+  Nan::HandleScope scope;
+  // The options object is optional and comes before the callbacks.
+  int callback_index = 2;
+  if (info.Length() > 2 && info[2]->IsObject() && !info[2]->IsFunction())
+    callback_index = 3;
+  if (info.Length() <= callback_index || !info[0]->IsString() ||
+      !info[1]->IsString() || !info[callback_index]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::string zip_file_path = *(Nan::Utf8String(info[0]));
+  std::string password = *(Nan::Utf8String(info[1]));
+
+  int threads = 1;
+  if (callback_index == 3 && !GetThreadsOption(info[2], &threads))
+    THROW_BAD_ARGS("'threads' must be a non-negative integer.");
+
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[callback_index].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > callback_index + 1 &&
+      info[callback_index + 1]->IsFunction()) {
+    error_callback =
+        new Nan::Callback(info[callback_index + 1].As<v8::Function>());
+  }
+
+  Nan::AsyncQueueWorker(new greenworks::VerifyArchiveWorker(
+      success_callback, error_callback, zip_file_path, password, threads));
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(OpenArchive) {
+  Nan::HandleScope scope;
+  if (info.Length() < 3 || !info[0]->IsString() || !info[1]->IsString() ||
+      !info[2]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::string zip_file_path = *(Nan::Utf8String(info[0]));
+  std::string password = *(Nan::Utf8String(info[1]));
+  Nan::Callback* success_callback =
+      new Nan::Callback(info[2].As<v8::Function>());
+  Nan::Callback* error_callback = nullptr;
+
+  if (info.Length() > 3 && info[3]->IsFunction())
+    error_callback = new Nan::Callback(info[3].As<v8::Function>());
+
+  Nan::AsyncQueueWorker(new greenworks::OpenArchiveWorker(
+      success_callback, error_callback, zip_file_path, password));
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(ReadEntry) {
+  Nan::HandleScope scope;
+  if (info.Length() < 3 || !info[0]->IsObject() || !info[1]->IsString() ||
+      !info[2]->IsFunction()) {
+    THROW_BAD_ARGS("bad arguments");
+  }
+  std::shared_ptr<greenworks::ArchiveReader> reader =
+      greenworks::ArchiveHandle::GetReader(info[0]);
+  if (!reader)
+    THROW_BAD_ARGS("The archive handle is closed or invalid.");
+  std::string name = *(Nan::Utf8String(info[1]));
   Nan::Callback* success_callback =
-      new Nan::Callback(info[3].As<v8::Function>());
+      new Nan::Callback(info[2].As<v8::Function>());
   Nan::Callback* error_callback = nullptr;
 
-  if (info.Length() > 4 && info[4]->IsFunction())
-    error_callback = new Nan::Callback(info[4].As<v8::Function>());
+  if (info.Length() > 3 && info[3]->IsFunction())
+    error_callback = new Nan::Callback(info[3].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::ExtractArchiveWorker(
-      success_callback, error_callback, zip_file_path, extract_dir, password));
+  Nan::AsyncQueueWorker(new greenworks::ReadArchiveEntryWorker(
+      success_callback, error_callback, reader, name));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -65,6 +393,12 @@ void RegisterAPIs(v8::Local<v8::Object> exports) {
   v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
   Nan::SetMethod(tpl, "createArchive", CreateArchive);
   Nan::SetMethod(tpl, "extractArchive", ExtractArchive);
+  Nan::SetMethod(tpl, "createArchiveToBuffer", CreateArchiveToBuffer);
+  Nan::SetMethod(tpl, "extractArchiveFromBuffer", ExtractArchiveFromBuffer);
+  Nan::SetMethod(tpl, "listArchive", ListArchive);
+  Nan::SetMethod(tpl, "verifyArchive", VerifyArchive);
+  Nan::SetMethod(tpl, "openArchive", OpenArchive);
+  Nan::SetMethod(tpl, "readEntry", ReadEntry);
   Nan::Persistent<v8::Function> constructor;
   constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
   Nan::Set(exports, Nan::New("Utils").ToLocalChecked(),
@@ -25,8 +25,9 @@ NAN_METHOD(GetAuthSessionTicket) {
   Nan::Callback* error_callback = nullptr;
   if (info.Length() > 1 && info[1]->IsFunction())
     error_callback = new Nan::Callback(info[1].As<v8::Function>());
-  Nan::AsyncQueueWorker(new greenworks::GetAuthSessionTicketWorker(
-    success_callback, error_callback));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::GetAuthSessionTicketWorker(success_callback,
+          error_callback));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -54,8 +55,9 @@ NAN_METHOD(GetEncryptedAppTicket) {
   Nan::Callback* error_callback = nullptr;
   if (info.Length() > 2 && info[2]->IsFunction())
     error_callback = new Nan::Callback(info[2].As<v8::Function>());
-  Nan::AsyncQueueWorker(new greenworks::RequestEncryptedAppTicketWorker(
-    user_data, success_callback, error_callback));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::RequestEncryptedAppTicketWorker(user_data,
+          success_callback, error_callback));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
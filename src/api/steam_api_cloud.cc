@@ -18,13 +18,18 @@ namespace {
 NAN_METHOD(SaveTextToFile) {
   Nan::HandleScope scope;
 
-  if (info.Length() < 3 || !info[0]->IsString() || !info[1]->IsString() ||
+  if (info.Length() < 3 || !info[0]->IsString() ||
+      !(info[1]->IsString() || node::Buffer::HasInstance(info[1])) ||
       !info[2]->IsFunction()) {
     THROW_BAD_ARGS("Bad arguments");
   }
 
   std::string file_name(*(Nan::Utf8String(info[0])));
-  std::string content(*(Nan::Utf8String(info[1])));
+  // A Buffer is saved as is, e.g. an archive from createArchiveToBuffer().
+  std::string content = node::Buffer::HasInstance(info[1])
+      ? std::string(node::Buffer::Data(info[1]),
+                    node::Buffer::Length(info[1]))
+      : std::string(*(Nan::Utf8String(info[1])));
   Nan::Callback* success_callback =
       new Nan::Callback(info[2].As<v8::Function>());
   Nan::Callback* error_callback = nullptr;
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <memory>
+#include <string>
 
 #include "nan.h"
 #include "steam/steam_api.h"
@@ -12,6 +13,11 @@
 #include "steam_api_registry.h"
 #include "steam_id.h"
 
+// BigUint64Array is available since V8 6.7 (Node.js v10.4).
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+#define GREENWORKS_HAS_BIGUINT64_ARRAY
+#endif
+
 namespace greenworks {
 namespace api {
 namespace {
@@ -153,6 +159,75 @@ NAN_METHOD(GetFriends) {
   info.GetReturnValue().Set(friends);
 }
 
+NAN_METHOD(GetFriendsSnapshot) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1 || !info[0]->IsInt32()) {
+    THROW_BAD_ARGS("Bad arguments");
+  }
+  auto friend_flag = static_cast<EFriendFlags>(Nan::To<int32>(info[0]).FromJust());
+  ISteamFriends* steam_friends = SteamFriends();
+  int friends_count = steam_friends->GetFriendCount(friend_flag);
+  size_t count = friends_count > 0 ? friends_count : 0;
+
+#if defined(GREENWORKS_HAS_BIGUINT64_ARRAY)
+  uint64_t* ids_data = nullptr;
+  v8::Local<v8::BigUint64Array> ids =
+      utils::NewTypedArray<v8::BigUint64Array>(count, &ids_data);
+#else
+  v8::Local<v8::Array> ids = Nan::New<v8::Array>(count);
+#endif
+  uint8_t* persona_states_data = nullptr;
+  v8::Local<v8::Uint8Array> persona_states =
+      utils::NewTypedArray<v8::Uint8Array>(count, &persona_states_data);
+  uint8_t* relationships_data = nullptr;
+  v8::Local<v8::Uint8Array> relationships =
+      utils::NewTypedArray<v8::Uint8Array>(count, &relationships_data);
+  int32_t* steam_levels_data = nullptr;
+  v8::Local<v8::Int32Array> steam_levels =
+      utils::NewTypedArray<v8::Int32Array>(count, &steam_levels_data);
+  uint32_t* game_app_ids_data = nullptr;
+  v8::Local<v8::Uint32Array> game_app_ids =
+      utils::NewTypedArray<v8::Uint32Array>(count, &game_app_ids_data);
+  uint32_t* name_offsets_data = nullptr;
+  v8::Local<v8::Uint32Array> name_offsets =
+      utils::NewTypedArray<v8::Uint32Array>(count + 1, &name_offsets_data);
+
+  std::string names;
+  for (size_t i = 0; i < count; ++i) {
+    CSteamID steam_id = steam_friends->GetFriendByIndex(i, friend_flag);
+#if defined(GREENWORKS_HAS_BIGUINT64_ARRAY)
+    ids_data[i] = steam_id.ConvertToUint64();
+#else
+    Nan::Set(ids, i, Nan::New(utils::uint64ToString(
+                         steam_id.ConvertToUint64())).ToLocalChecked());
+#endif
+    persona_states_data[i] = static_cast<uint8_t>(
+        steam_friends->GetFriendPersonaState(steam_id));
+    relationships_data[i] = static_cast<uint8_t>(
+        steam_friends->GetFriendRelationship(steam_id));
+    steam_levels_data[i] = steam_friends->GetFriendSteamLevel(steam_id);
+    FriendGameInfo_t game_info;
+    if (steam_friends->GetFriendGamePlayed(steam_id, &game_info))
+      game_app_ids_data[i] = game_info.m_gameID.AppID();
+    name_offsets_data[i] = names.size();
+    names.append(steam_friends->GetFriendPersonaName(steam_id));
+  }
+  name_offsets_data[count] = names.size();
+
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("count").ToLocalChecked(),
+           Nan::New(static_cast<uint32>(count)));
+  Nan::Set(result, Nan::New("ids").ToLocalChecked(), ids);
+  Nan::Set(result, Nan::New("personaStates").ToLocalChecked(), persona_states);
+  Nan::Set(result, Nan::New("relationships").ToLocalChecked(), relationships);
+  Nan::Set(result, Nan::New("steamLevels").ToLocalChecked(), steam_levels);
+  Nan::Set(result, Nan::New("gameAppIds").ToLocalChecked(), game_app_ids);
+  Nan::Set(result, Nan::New("names").ToLocalChecked(),
+           Nan::CopyBuffer(names.data(), names.size()).ToLocalChecked());
+  Nan::Set(result, Nan::New("nameOffsets").ToLocalChecked(), name_offsets);
+  info.GetReturnValue().Set(result);
+}
+
 NAN_METHOD(GetSmallFriendAvatar) {
   Nan::HandleScope scope;
   if (info.Length() < 1 || !info[0]->IsString()) {
@@ -398,6 +473,7 @@ void RegisterAPIs(v8::Local<v8::Object> target) {
 
   SET_FUNCTION("getFriendCount", GetFriendCount);
   SET_FUNCTION("getFriends", GetFriends);
+  SET_FUNCTION("getFriendsSnapshot", GetFriendsSnapshot);
   SET_FUNCTION("getSmallFriendAvatar", GetSmallFriendAvatar);
   SET_FUNCTION("getMediumFriendAvatar", GetMediumFriendAvatar);
   SET_FUNCTION("getLargeFriendAvatar", GetLargeFriendAvatar);
@@ -26,7 +26,7 @@ NAN_METHOD(ConsumeItem) {
   uint64_t itemConsume = utils::strToUint64(itemConsumeStr);
   uint32_t unQuantity = Nan::To<uint32>(info[1]).FromJust();
 
-  Nan::AsyncQueueWorker(new greenworks::ConsumeItemWorker(success_callback, error_callback, itemConsume, unQuantity));
+  greenworks::SteamCallbackAsyncWorker::Queue(new greenworks::ConsumeItemWorker(success_callback, error_callback, itemConsume, unQuantity));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -87,7 +87,7 @@ NAN_METHOD(ExchangeItems) {
   if (info.Length() > 3 && info[3]->IsFunction())
     error_callback = new Nan::Callback(info[3].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::ExchangeItemsWorker(success_callback, error_callback, pArrayItemDefsGenerate, punArrayQuantityGenerate, unArrayLengthGenerate, pArrayItemInstancesDestroy, punArrayQuantityDestroy, unArrayLengthDestroy));
+  greenworks::SteamCallbackAsyncWorker::Queue(new greenworks::ExchangeItemsWorker(success_callback, error_callback, pArrayItemDefsGenerate, punArrayQuantityGenerate, unArrayLengthGenerate, pArrayItemInstancesDestroy, punArrayQuantityDestroy, unArrayLengthDestroy));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -143,8 +143,8 @@ NAN_METHOD(GetAllItems) {
   if (info.Length() > 1 && info[1]->IsFunction())
     error_callback = new Nan::Callback(info[1].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::GetAllItemsWorker(
-      success_callback, error_callback));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::GetAllItemsWorker(success_callback, error_callback));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -14,6 +14,7 @@
 #include "greenworks_version.h"
 #include "steam_api_registry.h"
 #include "steam_client.h"
+#include "steam_dispatcher.h"
 #include "steam_event.h"
 #include "steam_id.h"
 
@@ -201,8 +202,9 @@ NAN_METHOD(GetNumberOfPlayers) {
   if (info.Length() > 1 && info[1]->IsFunction())
     error_callback = new Nan::Callback(info[1].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::GetNumberOfPlayersWorker(
-      success_callback, error_callback));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::GetNumberOfPlayersWorker(success_callback,
+          error_callback));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -321,10 +323,91 @@ NAN_METHOD(GetLaunchCommandLine) {
 
 NAN_METHOD(RunCallbacks) {
   Nan::HandleScope scope;
-  SteamAPI_RunCallbacks();
+  // SteamAPI_RunCallbacks() must not be called in manual dispatch mode;
+  // have the dispatch thread run a frame instead.
+  if (greenworks::SteamDispatcher::IsRunning())
+    greenworks::SteamDispatcher::Wake();
+  else
+    SteamAPI_RunCallbacks();
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
+NAN_METHOD(SetSteamLoopOptions) {
+  Nan::HandleScope scope;
+  if (info.Length() < 1 || !info[0]->IsObject()) {
+    THROW_BAD_ARGS("Bad arguments");
+  }
+  v8::Local<v8::Object> options = Nan::To<v8::Object>(info[0]).ToLocalChecked();
+  greenworks::SteamClient::LoopOptions loop_options =
+      greenworks::SteamClient::GetLoopOptions();
+
+  v8::Local<v8::Value> fast_interval =
+      Nan::Get(options, Nan::New("fast_interval").ToLocalChecked())
+          .ToLocalChecked();
+  v8::Local<v8::Value> idle_interval =
+      Nan::Get(options, Nan::New("idle_interval").ToLocalChecked())
+          .ToLocalChecked();
+  v8::Local<v8::Value> unref =
+      Nan::Get(options, Nan::New("unref").ToLocalChecked()).ToLocalChecked();
+  if (!fast_interval->IsUndefined()) {
+    uint32 value = fast_interval->IsUint32()
+        ? Nan::To<uint32>(fast_interval).FromJust() : 0;
+    if (value == 0)
+      THROW_BAD_ARGS("'fast_interval' must be a positive integer.");
+    loop_options.fast_interval_ms = value;
+  }
+  if (!idle_interval->IsUndefined()) {
+    uint32 value = idle_interval->IsUint32()
+        ? Nan::To<uint32>(idle_interval).FromJust() : 0;
+    if (value == 0)
+      THROW_BAD_ARGS("'idle_interval' must be a positive integer.");
+    loop_options.idle_interval_ms = value;
+  }
+  if (!unref->IsUndefined())
+    loop_options.unref = Nan::To<bool>(unref).FromJust();
+  v8::Local<v8::Value> dispatch_thread =
+      Nan::Get(options, Nan::New("dispatch_thread").ToLocalChecked())
+          .ToLocalChecked();
+  if (!dispatch_thread->IsUndefined()) {
+    bool enabled = Nan::To<bool>(dispatch_thread).FromJust();
+    if (enabled && !greenworks::SteamDispatcher::IsSupported()) {
+      THROW_BAD_ARGS("'dispatch_thread' requires Greenworks to be built with "
+                     "steam_manual_dispatch=1.");
+    }
+    if (enabled != loop_options.dispatch_thread &&
+        greenworks::SteamClient::IsSteamLoopStarted()) {
+      THROW_BAD_ARGS("'dispatch_thread' must be set before initAPI().");
+    }
+    loop_options.dispatch_thread = enabled;
+  }
+
+  greenworks::SteamClient::SetLoopOptions(loop_options);
+  info.GetReturnValue().Set(Nan::Undefined());
+}
+
+NAN_METHOD(GetSteamLoopStats) {
+  Nan::HandleScope scope;
+  greenworks::SteamClient::LoopStats stats =
+      greenworks::SteamClient::GetLoopStats();
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("interval").ToLocalChecked(),
+           Nan::New<v8::Number>(static_cast<double>(stats.interval_ms)));
+  Nan::Set(result, Nan::New("ticks").ToLocalChecked(),
+           Nan::New<v8::Number>(static_cast<double>(stats.ticks)));
+  Nan::Set(result, Nan::New("lastTickCost").ToLocalChecked(),
+           Nan::New<v8::Number>(static_cast<double>(stats.last_tick_cost_us)));
+  Nan::Set(
+      result, Nan::New("averageTickCost").ToLocalChecked(),
+      Nan::New<v8::Number>(static_cast<double>(stats.average_tick_cost_us)));
+  Nan::Set(result, Nan::New("maxTickCost").ToLocalChecked(),
+           Nan::New<v8::Number>(static_cast<double>(stats.max_tick_cost_us)));
+  Nan::Set(result, Nan::New("pendingCallResults").ToLocalChecked(),
+           Nan::New(stats.pending_call_results));
+  Nan::Set(result, Nan::New("dispatchThread").ToLocalChecked(),
+           Nan::New(greenworks::SteamDispatcher::IsRunning()));
+  info.GetReturnValue().Set(result);
+}
+
 void RegisterAPIs(v8::Local<v8::Object> target) {
   Nan::Set(target,
            Nan::New("_version").ToLocalChecked(),
@@ -350,6 +433,8 @@ void RegisterAPIs(v8::Local<v8::Object> target) {
   SET_FUNCTION("getImageRGBA", GetImageRGBA);
   SET_FUNCTION("getIPCountry", GetIPCountry);
   SET_FUNCTION("getLaunchCommandLine", GetLaunchCommandLine);
+  SET_FUNCTION("setSteamLoopOptions", SetSteamLoopOptions);
+  SET_FUNCTION("getSteamLoopStats", GetSteamLoopStats);
 }
 
 SteamAPIRegistry::Add X(RegisterAPIs);
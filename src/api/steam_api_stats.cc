@@ -39,8 +39,8 @@ StoreUserStatsWorker::StoreUserStatsWorker(Nan::Callback* success_callback,
       result(this, &StoreUserStatsWorker::OnStoreUserStatsCompleted) {}
 
 void StoreUserStatsWorker::Execute() {
+  WatchCallback(&result);
   SteamUserStats()->StoreStats();
-  WaitForCompleted();
 }
 
 void StoreUserStatsWorker::OnStoreUserStatsCompleted(
@@ -50,7 +50,7 @@ void StoreUserStatsWorker::OnStoreUserStatsCompleted(
   } else {
     game_id_ = result->m_nGameID;
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void StoreUserStatsWorker::HandleOKCallback() {
@@ -120,7 +120,7 @@ NAN_METHOD(StoreStats) {
   if (info.Length() > 1 && info[1]->IsFunction())
     error_callback = new Nan::Callback(info[1].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(
+  SteamCallbackAsyncWorker::Queue(
       new StoreUserStatsWorker(success_callback, error_callback));
   info.GetReturnValue().Set(Nan::Undefined());
 }
@@ -133,8 +133,9 @@ NAN_METHOD(FileShare) {
   if (info.Length() > 2 && info[2]->IsFunction())
     error_callback = new Nan::Callback(info[2].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::FileShareWorker(
-      success_callback, error_callback, file_name));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::FileShareWorker(success_callback, error_callback,
+          file_name));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -181,9 +182,10 @@ NAN_METHOD(PublishWorkshopFile) {
   properties.title = (*(Nan::Utf8String(info[3])));
   properties.description = (*(Nan::Utf8String(info[4])));
 
-  Nan::AsyncQueueWorker(new greenworks::PublishWorkshopFileWorker(
-      success_callback, error_callback, Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
-      properties));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::PublishWorkshopFileWorker(success_callback,
+          error_callback, Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
+          properties));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -228,8 +230,9 @@ NAN_METHOD(UpdatePublishedWorkshopFile) {
   properties.title = (*(Nan::Utf8String(info[4])));
   properties.description = (*(Nan::Utf8String(info[5])));
 
-  Nan::AsyncQueueWorker(new greenworks::UpdatePublishedWorkshopFileWorker(
-      success_callback, error_callback, published_file_id, properties));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::UpdatePublishedWorkshopFileWorker(success_callback,
+          error_callback, published_file_id, properties));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -260,10 +263,11 @@ NAN_METHOD(UGCGetItems) {
   if (info.Length() > 4 && info[4]->IsFunction())
     error_callback = new Nan::Callback(info[4].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::QueryAllUGCWorker(
-      success_callback, error_callback, ugc_matching_type, ugc_query_type,
-      Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
-      Nan::To<int32>(page_num.ToLocalChecked()).FromJust()));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::QueryAllUGCWorker(success_callback, error_callback,
+          ugc_matching_type, ugc_query_type,
+          Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
+          Nan::To<int32>(page_num.ToLocalChecked()).FromJust()));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -296,9 +300,10 @@ NAN_METHOD(UGCGetUserItems) {
   if (info.Length() > 5 && info[5]->IsFunction())
     error_callback = new Nan::Callback(info[4].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::QueryUserUGCWorker(
-      success_callback, error_callback, ugc_matching_type, ugc_list,
-      ugc_list_order, Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::QueryUserUGCWorker(success_callback, error_callback,
+          ugc_matching_type, ugc_list, ugc_list_order,
+          Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
           Nan::To<int32>(page_num.ToLocalChecked()).FromJust()));
   info.GetReturnValue().Set(Nan::Undefined());
 }
@@ -320,8 +325,9 @@ NAN_METHOD(UGCDownloadItem) {
   if (info.Length() > 3 && info[3]->IsFunction())
     error_callback = new Nan::Callback(info[3].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::DownloadItemWorker(
-      success_callback, error_callback, download_file_handle, download_dir));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::DownloadItemWorker(success_callback, error_callback,
+          download_file_handle, download_dir));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -350,10 +356,10 @@ NAN_METHOD(UGCSynchronizeItems) {
   if (info.Length() > 3 && info[3]->IsFunction())
     error_callback = new Nan::Callback(info[3].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::SynchronizeItemsWorker(
-      success_callback, error_callback, download_dir,
-      Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
-      Nan::To<int32>(page_num.ToLocalChecked()).FromJust()));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::SynchronizeItemsWorker(success_callback, error_callback,
+          download_dir, Nan::To<int32>(app_id.ToLocalChecked()).FromJust(),
+          Nan::To<int32>(page_num.ToLocalChecked()).FromJust()));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
@@ -391,8 +397,9 @@ NAN_METHOD(UGCUnsubscribe) {
   if (info.Length() > 2 && info[2]->IsFunction())
     error_callback = new Nan::Callback(info[2].As<v8::Function>());
 
-  Nan::AsyncQueueWorker(new greenworks::UnsubscribePublishedFileWorker(
-      success_callback, error_callback, unsubscribed_file_id));
+  greenworks::SteamCallbackAsyncWorker::Queue(
+      new greenworks::UnsubscribePublishedFileWorker(success_callback,
+          error_callback, unsubscribed_file_id));
   info.GetReturnValue().Set(Nan::Undefined());
 }
 
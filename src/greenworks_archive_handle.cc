@@ -0,0 +1,118 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "greenworks_archive_handle.h"
+
+#include <string>
+
+#include "v8.h"
+
+namespace greenworks {
+
+namespace {
+
+Nan::Persistent<v8::FunctionTemplate> g_archive_handle_template;
+Nan::Persistent<v8::FunctionTemplate> g_cancel_handle_template;
+
+}  // namespace
+
+v8::Local<v8::FunctionTemplate> ArchiveHandle::GetTemplate() {
+  Nan::EscapableHandleScope scope;
+  if (!g_archive_handle_template.IsEmpty())
+    return scope.Escape(Nan::New(g_archive_handle_template));
+
+  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+  tpl->SetClassName(Nan::New("ArchiveHandle").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  SetPrototypeMethod(tpl, "close", Close);
+  SetPrototypeMethod(tpl, "getEntryCount", GetEntryCount);
+  SetPrototypeMethod(tpl, "hasEntry", HasEntry);
+
+  g_archive_handle_template.Reset(tpl);
+  return scope.Escape(tpl);
+}
+
+v8::Local<v8::Object> ArchiveHandle::Create(
+    std::shared_ptr<ArchiveReader> reader) {
+  Nan::EscapableHandleScope scope;
+  v8::Local<v8::Function> constructor =
+      Nan::GetFunction(GetTemplate()).ToLocalChecked();
+  v8::Local<v8::Object> instance =
+      Nan::NewInstance(constructor).ToLocalChecked();
+  // The handle is freed with its JS object, which closes the archive.
+  auto* obj = new ArchiveHandle(reader);
+  obj->Wrap(instance);
+  return scope.Escape(instance);
+}
+
+std::shared_ptr<ArchiveReader> ArchiveHandle::GetReader(
+    v8::Local<v8::Value> value) {
+  if (!value->IsObject() || !GetTemplate()->HasInstance(value))
+    return nullptr;
+  return ObjectWrap::Unwrap<ArchiveHandle>(value.As<v8::Object>())->reader_;
+}
+
+NAN_METHOD(ArchiveHandle::Close) {
+  auto* obj = ObjectWrap::Unwrap<ArchiveHandle>(info.Holder());
+  obj->reader_.reset();
+}
+
+NAN_METHOD(ArchiveHandle::GetEntryCount) {
+  auto* obj = ObjectWrap::Unwrap<ArchiveHandle>(info.Holder());
+  if (!obj->reader_) {
+    Nan::ThrowError("Archive is closed.");
+    return;
+  }
+  info.GetReturnValue().Set(
+      Nan::New(static_cast<double>(obj->reader_->entry_count())));
+}
+
+NAN_METHOD(ArchiveHandle::HasEntry) {
+  auto* obj = ObjectWrap::Unwrap<ArchiveHandle>(info.Holder());
+  if (info.Length() < 1 || !info[0]->IsString()) {
+    Nan::ThrowTypeError("Bad arguments");
+    return;
+  }
+  if (!obj->reader_) {
+    Nan::ThrowError("Archive is closed.");
+    return;
+  }
+  std::string name = *(Nan::Utf8String(info[0]));
+  info.GetReturnValue().Set(obj->reader_->Find(name) != nullptr);
+}
+
+v8::Local<v8::FunctionTemplate> ArchiveCancelHandle::GetTemplate() {
+  Nan::EscapableHandleScope scope;
+  if (!g_cancel_handle_template.IsEmpty())
+    return scope.Escape(Nan::New(g_cancel_handle_template));
+
+  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
+  tpl->SetClassName(Nan::New("ArchiveCancelHandle").ToLocalChecked());
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  SetPrototypeMethod(tpl, "cancel", Cancel);
+
+  g_cancel_handle_template.Reset(tpl);
+  return scope.Escape(tpl);
+}
+
+v8::Local<v8::Object> ArchiveCancelHandle::Create(
+    std::shared_ptr<ArchiveProgress> progress) {
+  Nan::EscapableHandleScope scope;
+  v8::Local<v8::Function> constructor =
+      Nan::GetFunction(GetTemplate()).ToLocalChecked();
+  v8::Local<v8::Object> instance =
+      Nan::NewInstance(constructor).ToLocalChecked();
+  auto* obj = new ArchiveCancelHandle(progress);
+  obj->Wrap(instance);
+  return scope.Escape(instance);
+}
+
+NAN_METHOD(ArchiveCancelHandle::Cancel) {
+  auto* obj = ObjectWrap::Unwrap<ArchiveCancelHandle>(info.Holder());
+  obj->progress_->Cancel();
+}
+
+}  // namespace greenworks
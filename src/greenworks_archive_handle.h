@@ -0,0 +1,63 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_GREENWORKS_ARCHIVE_HANDLE_H_
+#define SRC_GREENWORKS_ARCHIVE_HANDLE_H_
+
+#include <memory>
+
+#include "nan.h"
+
+#include "greenworks_archive_progress.h"
+#include "greenworks_unzip.h"
+
+namespace greenworks {
+
+// The object returned by greenworks.Utils.openArchive(). It keeps the indexed
+// archive open until close() is called or it is garbage collected. Reads in
+// progress hold their own reference, so closing doesn't cut them short.
+class ArchiveHandle : public Nan::ObjectWrap {
+ public:
+  static v8::Local<v8::Object> Create(std::shared_ptr<ArchiveReader> reader);
+  // Returns null if |value| isn't an archive handle or it has been closed.
+  static std::shared_ptr<ArchiveReader> GetReader(v8::Local<v8::Value> value);
+
+  static NAN_METHOD(Close);
+  static NAN_METHOD(GetEntryCount);
+  static NAN_METHOD(HasEntry);
+
+ private:
+  // Builds the ArchiveHandle template on first use and caches it.
+  static v8::Local<v8::FunctionTemplate> GetTemplate();
+
+  explicit ArchiveHandle(std::shared_ptr<ArchiveReader> reader)
+      : reader_(reader) {}
+  ~ArchiveHandle() override {}
+
+  std::shared_ptr<ArchiveReader> reader_;
+};
+
+// The object returned by greenworks.Utils.createArchive() and
+// extractArchive(). Its cancel() makes the call stop at its next buffer and
+// fail; it does nothing once the call has finished.
+class ArchiveCancelHandle : public Nan::ObjectWrap {
+ public:
+  static v8::Local<v8::Object> Create(
+      std::shared_ptr<ArchiveProgress> progress);
+
+  static NAN_METHOD(Cancel);
+
+ private:
+  static v8::Local<v8::FunctionTemplate> GetTemplate();
+
+  explicit ArchiveCancelHandle(std::shared_ptr<ArchiveProgress> progress)
+      : progress_(progress) {}
+  ~ArchiveCancelHandle() override {}
+
+  std::shared_ptr<ArchiveProgress> progress_;
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_GREENWORKS_ARCHIVE_HANDLE_H_
@@ -0,0 +1,39 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "greenworks_archive_progress.h"
+
+namespace greenworks {
+
+ArchiveProgress::ArchiveProgress()
+    : cancelled_(false),
+      entries_done_(0),
+      entry_count_(0),
+      bytes_in_(0),
+      bytes_out_(0),
+      total_bytes_(0) {}
+
+void ArchiveProgress::AddEntries(uint64_t count, uint64_t bytes) {
+  entry_count_ += count;
+  total_bytes_ += bytes;
+}
+
+void ArchiveProgress::StartEntry(const std::string& name) {
+  std::lock_guard<std::mutex> lock(current_entry_mutex_);
+  current_entry_ = name;
+}
+
+ArchiveProgress::Snapshot ArchiveProgress::GetSnapshot() const {
+  Snapshot snapshot;
+  snapshot.entries_done = entries_done_;
+  snapshot.entry_count = entry_count_;
+  snapshot.bytes_in = bytes_in_;
+  snapshot.bytes_out = bytes_out_;
+  snapshot.total_bytes = total_bytes_;
+  std::lock_guard<std::mutex> lock(current_entry_mutex_);
+  snapshot.current_entry = current_entry_;
+  return snapshot;
+}
+
+}  // namespace greenworks
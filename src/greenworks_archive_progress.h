@@ -0,0 +1,68 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_GREENWORKS_ARCHIVE_PROGRESS_H_
+#define SRC_GREENWORKS_ARCHIVE_PROGRESS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace greenworks {
+
+// Returned by zip() and unzip() when they were cancelled.
+const int kArchiveCancelled = -200;
+
+// How far a zip() or unzip() call has got. The threads doing the work update
+// it as they go, and any other thread may read it or cancel the call, which
+// then stops before its next buffer.
+class ArchiveProgress {
+ public:
+  struct Snapshot {
+    uint64_t entries_done;
+    // May still grow while zip() walks the source directory.
+    uint64_t entry_count;
+    // Bytes read from the source files or the archive.
+    uint64_t bytes_in;
+    // Bytes written to the archive or the extracted files.
+    uint64_t bytes_out;
+    // Size of all the files once extracted.
+    uint64_t total_bytes;
+    // The entry started last.
+    std::string current_entry;
+  };
+
+  ArchiveProgress();
+
+  void Cancel() { cancelled_ = true; }
+  bool IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+  void AddEntries(uint64_t count, uint64_t bytes);
+  void StartEntry(const std::string& name);
+  void FinishEntry() { ++entries_done_; }
+  void AddBytesIn(uint64_t size) { bytes_in_ += size; }
+  void AddBytesOut(uint64_t size) { bytes_out_ += size; }
+
+  Snapshot GetSnapshot() const;
+
+ private:
+  std::atomic<bool> cancelled_;
+  std::atomic<uint64_t> entries_done_;
+  std::atomic<uint64_t> entry_count_;
+  std::atomic<uint64_t> bytes_in_;
+  std::atomic<uint64_t> bytes_out_;
+  std::atomic<uint64_t> total_bytes_;
+  mutable std::mutex current_entry_mutex_;
+  std::string current_entry_;
+
+  ArchiveProgress(const ArchiveProgress&) = delete;
+  ArchiveProgress& operator=(const ArchiveProgress&) = delete;
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_GREENWORKS_ARCHIVE_PROGRESS_H_
@@ -4,12 +4,15 @@
 
 #include "greenworks_async_workers.h"
 
+#include <algorithm>
+#include <limits>
 #include <sstream>
 #include <iomanip>
 #include "nan.h"
 #include "steam/steam_api.h"
 #include "v8.h"
 
+#include "greenworks_archive_handle.h"
 #include "greenworks_unzip.h"
 #include "greenworks_zip.h"
 
@@ -25,6 +28,17 @@ struct FilesContentContainer {
   }
 };
 
+void OnProgressTimerClosed(uv_handle_t* handle) {
+  delete reinterpret_cast<uv_timer_t*>(handle);
+}
+
+// Nan::NewBuffer() takes a uint32_t length, which can be less than
+// node::Buffer::kMaxLength on 64-bit builds of newer Node versions.
+bool FitsInBuffer(size_t size) {
+  return size <= node::Buffer::kMaxLength &&
+         size <= std::numeric_limits<uint32_t>::max();
+}
+
 };  // namespace
 
 namespace greenworks {
@@ -231,8 +245,7 @@ void GetNumberOfPlayersWorker::Execute() {
   SteamAPICall_t steam_api_call = SteamUserStats()->GetNumberOfCurrentPlayers();
   call_result_.Set(steam_api_call, this,
       &GetNumberOfPlayersWorker::OnGetNumberOfPlayersCompleted);
-
-  WaitForCompleted();
+  WatchCallResult(&call_result_, steam_api_call);
 }
 
 void GetNumberOfPlayersWorker::OnGetNumberOfPlayersCompleted(
@@ -244,7 +257,7 @@ void GetNumberOfPlayersWorker::OnGetNumberOfPlayersCompleted(
   } else {
     SetErrorMessage("Error on getting number of players.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void GetNumberOfPlayersWorker::HandleOKCallback() {
@@ -255,40 +268,472 @@ void GetNumberOfPlayersWorker::HandleOKCallback() {
   callback->Call(1, argv, &resource);
 }
 
+ArchiveWorker::ArchiveWorker(Nan::Callback* success_callback,
+    Nan::Callback* error_callback, Nan::Callback* progress_callback)
+        : SteamAsyncWorker(success_callback, error_callback),
+          progress_(std::make_shared<ArchiveProgress>()),
+          progress_callback_(progress_callback),
+          progress_timer_(nullptr),
+          last_snapshot_(progress_->GetSnapshot()),
+          last_report_time_(uv_hrtime()) {
+  if (!progress_callback_)
+    return;
+  progress_timer_ = new uv_timer_t();
+  uv_timer_init(uv_default_loop(), progress_timer_);
+  progress_timer_->data = this;
+  uv_timer_start(progress_timer_, &ArchiveWorker::OnProgressTimer, 100, 100);
+}
+
+ArchiveWorker::~ArchiveWorker() {
+  delete progress_callback_;
+}
+
+void ArchiveWorker::WorkComplete() {
+  if (progress_timer_) {
+    uv_timer_stop(progress_timer_);
+    uv_close(reinterpret_cast<uv_handle_t*>(progress_timer_),
+             &OnProgressTimerClosed);
+    progress_timer_ = nullptr;
+    // The last files done since the previous tick.
+    ReportProgress();
+  }
+  SteamAsyncWorker::WorkComplete();
+}
+
+void ArchiveWorker::SetArchiveError(int result, const std::string& message) {
+  if (result == kArchiveCancelled)
+    SetErrorMessage("Cancelled.");
+  else
+    SetErrorMessage(message.c_str());
+}
+
+#if NAUV_UVVERSION < 0x000b17
+void ArchiveWorker::OnProgressTimer(uv_timer_t* handle, int status_code) {
+#else
+void ArchiveWorker::OnProgressTimer(uv_timer_t* handle) {
+#endif
+  static_cast<ArchiveWorker*>(handle->data)->ReportProgress();
+}
+
+void ArchiveWorker::ReportProgress() {
+  ArchiveProgress::Snapshot snapshot = progress_->GetSnapshot();
+  if (snapshot.entries_done == last_snapshot_.entries_done &&
+      snapshot.bytes_in == last_snapshot_.bytes_in &&
+      snapshot.bytes_out == last_snapshot_.bytes_out) {
+    return;
+  }
+  uint64_t now = uv_hrtime();
+  double seconds = std::max<uint64_t>(now - last_report_time_, 1) / 1e9;
+  double bytes_in_per_second =
+      (snapshot.bytes_in - last_snapshot_.bytes_in) / seconds;
+  double bytes_out_per_second =
+      (snapshot.bytes_out - last_snapshot_.bytes_out) / seconds;
+  last_report_time_ = now;
+
+  Nan::HandleScope scope;
+  v8::Local<v8::Object> progress = Nan::New<v8::Object>();
+  Nan::Set(progress, Nan::New("entriesDone").ToLocalChecked(),
+           Nan::New(static_cast<double>(snapshot.entries_done)));
+  Nan::Set(progress, Nan::New("entryCount").ToLocalChecked(),
+           Nan::New(static_cast<double>(snapshot.entry_count)));
+  Nan::Set(progress, Nan::New("bytesIn").ToLocalChecked(),
+           Nan::New(static_cast<double>(snapshot.bytes_in)));
+  Nan::Set(progress, Nan::New("bytesOut").ToLocalChecked(),
+           Nan::New(static_cast<double>(snapshot.bytes_out)));
+  Nan::Set(progress, Nan::New("totalBytes").ToLocalChecked(),
+           Nan::New(static_cast<double>(snapshot.total_bytes)));
+  Nan::Set(progress, Nan::New("bytesInPerSecond").ToLocalChecked(),
+           Nan::New(bytes_in_per_second));
+  Nan::Set(progress, Nan::New("bytesOutPerSecond").ToLocalChecked(),
+           Nan::New(bytes_out_per_second));
+  Nan::Set(progress, Nan::New("currentEntry").ToLocalChecked(),
+           Nan::New(snapshot.current_entry).ToLocalChecked());
+  last_snapshot_ = std::move(snapshot);
+
+  v8::Local<v8::Value> argv[] = { progress };
+  Nan::AsyncResource resource("greenworks:ArchiveWorker.ReportProgress");
+  progress_callback_->Call(1, argv, &resource);
+}
+
 CreateArchiveWorker::CreateArchiveWorker(Nan::Callback* success_callback,
-    Nan::Callback* error_callback, const std::string& zip_file_path,
+    Nan::Callback* error_callback, Nan::Callback* progress_callback,
+    const std::string& zip_file_path,
     const std::string& source_dir, const std::string& password,
-    int compress_level)
-        :SteamAsyncWorker(success_callback, error_callback),
+    int compress_level, int threads, const std::string& previous_archive,
+    bool store_incompressible)
+        :ArchiveWorker(success_callback, error_callback, progress_callback),
          zip_file_path_(zip_file_path),
          source_dir_(source_dir),
          password_(password),
-         compress_level_(compress_level) {
+         compress_level_(compress_level),
+         threads_(threads),
+         previous_archive_(previous_archive),
+         store_incompressible_(store_incompressible) {
 }
 
 void CreateArchiveWorker::Execute() {
-  int result = zip(zip_file_path_.c_str(),
-                   source_dir_.c_str(),
-                   compress_level_,
-                   password_.empty()?nullptr:password_.c_str());
-  if (result)
-    SetErrorMessage("Error on creating zip file.");
+  ZipOptions options;
+  options.compression_level = compress_level_;
+  options.password = password_.empty()?nullptr:password_.c_str();
+  options.threads = threads_;
+  options.previous_archive = previous_archive_.c_str();
+  options.store_incompressible = store_incompressible_;
+  if (store_incompressible_)
+    options.report = &report_;
+  options.progress = progress().get();
+  std::string error;
+  int result = zip(zip_file_path_.c_str(), source_dir_.c_str(), options,
+                   &error);
+  if (result) {
+    if (error.empty())
+      SetArchiveError(result, "Error on creating zip file.");
+    else
+      SetArchiveError(result, "Error on creating zip file: " + error);
+  }
+}
+
+void CreateArchiveWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  Nan::AsyncResource resource(
+      "greenworks:CreateArchiveWorker.HandleOKCallback");
+  // Without store_incompressible, |report_| stays empty.
+  v8::Local<v8::Array> entries = Nan::New<v8::Array>(
+      static_cast<int>(report_.entries.size()));
+  for (size_t i = 0; i < report_.entries.size(); ++i) {
+    const ZipEntryReport& entry = report_.entries[i];
+    v8::Local<v8::Object> result = Nan::New<v8::Object>();
+    Nan::Set(result, Nan::New("name").ToLocalChecked(),
+             Nan::New(entry.name).ToLocalChecked());
+    Nan::Set(result, Nan::New("size").ToLocalChecked(),
+             Nan::New(static_cast<double>(entry.size)));
+    Nan::Set(result, Nan::New("stored").ToLocalChecked(),
+             Nan::New(entry.stored));
+    Nan::Set(entries, static_cast<uint32_t>(i), result);
+  }
+  v8::Local<v8::Object> report = Nan::New<v8::Object>();
+  Nan::Set(report, Nan::New("entries").ToLocalChecked(), entries);
+  Nan::Set(report, Nan::New("storedBytes").ToLocalChecked(),
+           Nan::New(static_cast<double>(report_.stored_bytes)));
+  v8::Local<v8::Value> argv[] = { report };
+  callback->Call(1, argv, &resource);
 }
 
 ExtractArchiveWorker::ExtractArchiveWorker(Nan::Callback* success_callback,
-    Nan::Callback* error_callback, const std::string& zip_file_path,
-    const std::string& extract_path, const std::string& password)
-        : SteamAsyncWorker(success_callback, error_callback),
+    Nan::Callback* error_callback, Nan::Callback* progress_callback,
+    const std::string& zip_file_path,
+    const std::string& extract_path, const std::string& password,
+    int threads, bool skip_unchanged, bool verify_crc,
+    const std::string& journal, bool deduplicate, bool hardlink_duplicates,
+    bool verify_duplicates)
+        : ArchiveWorker(success_callback, error_callback, progress_callback),
           zip_file_path_(zip_file_path),
           extract_path_(extract_path),
-          password_(password) {
+          password_(password),
+          threads_(threads),
+          skip_unchanged_(skip_unchanged),
+          verify_crc_(verify_crc),
+          journal_(journal),
+          deduplicate_(deduplicate),
+          hardlink_duplicates_(hardlink_duplicates),
+          verify_duplicates_(verify_duplicates) {
 }
 
 void ExtractArchiveWorker::Execute() {
-  int result = unzip(zip_file_path_.c_str(), extract_path_.c_str(),
-      password_.empty()?nullptr:password_.c_str());
+  UnzipOptions options;
+  options.password = password_.empty()?nullptr:password_.c_str();
+  options.threads = threads_;
+  options.skip_unchanged = skip_unchanged_;
+  options.verify_crc = verify_crc_;
+  options.journal = journal_.c_str();
+  options.deduplicate = deduplicate_;
+  options.hardlink_duplicates = hardlink_duplicates_;
+  options.verify_duplicates = verify_duplicates_;
+  options.progress = progress().get();
+  int result = unzip(zip_file_path_.c_str(), extract_path_.c_str(), options);
   if (result)
+    SetArchiveError(result, "Error on extracting zip file.");
+}
+
+CreateArchiveToBufferWorker::CreateArchiveToBufferWorker(
+    Nan::Callback* success_callback, Nan::Callback* error_callback,
+    const std::string& source_dir, const std::string& password,
+    int compress_level, int threads)
+        : SteamAsyncWorker(success_callback, error_callback),
+          source_dir_(source_dir),
+          password_(password),
+          compress_level_(compress_level),
+          threads_(threads),
+          archive_data_(nullptr),
+          archive_size_(0) {
+}
+
+CreateArchiveToBufferWorker::~CreateArchiveToBufferWorker() {
+  free(archive_data_);
+}
+
+void CreateArchiveToBufferWorker::AddEntry(const std::string& name,
+                                           const char* data, size_t size) {
+  ZipMemoryEntry entry;
+  entry.name = name;
+  entry.data = data;
+  entry.size = size;
+  entries_.push_back(entry);
+}
+
+void CreateArchiveToBufferWorker::Execute() {
+  ZipOptions options;
+  options.compression_level = compress_level_;
+  options.password = password_.empty()?nullptr:password_.c_str();
+  options.threads = threads_;
+  std::string error;
+  int result = source_dir_.empty()
+      ? zipToMemory(entries_, options, &archive_data_, &archive_size_)
+      : zipToMemory(source_dir_.c_str(), options, &archive_data_,
+                    &archive_size_, &error);
+  if (result) {
+    if (error.empty())
+      SetErrorMessage("Error on creating zip file.");
+    else
+      SetErrorMessage(("Error on creating zip file: " + error).c_str());
+  } else if (!FitsInBuffer(archive_size_)) {
+    SetErrorMessage("Zip file is too large for a Buffer.");
+  }
+}
+
+void CreateArchiveToBufferWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  // The Buffer takes over the archive and frees it with free().
+  v8::Local<v8::Value> argv[] = {
+      Nan::NewBuffer(archive_data_, static_cast<uint32_t>(archive_size_))
+          .ToLocalChecked() };
+  archive_data_ = nullptr;
+  Nan::AsyncResource resource(
+      "greenworks:CreateArchiveToBufferWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
+}
+
+ExtractArchiveFromBufferWorker::ExtractArchiveFromBufferWorker(
+    Nan::Callback* success_callback, Nan::Callback* error_callback,
+    const char* data, size_t size, const std::string& password, int threads)
+        : SteamAsyncWorker(success_callback, error_callback),
+          data_(data),
+          size_(size),
+          password_(password),
+          threads_(threads) {
+}
+
+ExtractArchiveFromBufferWorker::~ExtractArchiveFromBufferWorker() {
+  for (const UnzipMemoryEntry& entry : entries_)
+    free(entry.data);
+}
+
+void ExtractArchiveFromBufferWorker::Execute() {
+  UnzipOptions options;
+  options.password = password_.empty()?nullptr:password_.c_str();
+  options.threads = threads_;
+  int result = unzipToMemory(data_, size_, options, &entries_);
+  if (result) {
     SetErrorMessage("Error on extracting zip file.");
+    return;
+  }
+  for (const UnzipMemoryEntry& entry : entries_) {
+    if (!FitsInBuffer(entry.size)) {
+      SetErrorMessage("Zip entry is too large for a Buffer.");
+      return;
+    }
+  }
+}
+
+void ExtractArchiveFromBufferWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  v8::Local<v8::Array> files = Nan::New<v8::Array>(
+      static_cast<int>(entries_.size()));
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    UnzipMemoryEntry& entry = entries_[i];
+    v8::Local<v8::Object> file = Nan::New<v8::Object>();
+    Nan::Set(file, Nan::New("name").ToLocalChecked(),
+             Nan::New(entry.name).ToLocalChecked());
+    // The Buffer takes over the data and frees it with free().
+    Nan::Set(file, Nan::New("data").ToLocalChecked(),
+             Nan::NewBuffer(entry.data, static_cast<uint32_t>(entry.size))
+                 .ToLocalChecked());
+    entry.data = nullptr;
+    Nan::Set(files, static_cast<uint32_t>(i), file);
+  }
+  v8::Local<v8::Value> argv[] = { files };
+  Nan::AsyncResource resource(
+      "greenworks:ExtractArchiveFromBufferWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
+}
+
+ListArchiveWorker::ListArchiveWorker(Nan::Callback* success_callback,
+    Nan::Callback* error_callback, const std::string& zip_file_path)
+        : SteamAsyncWorker(success_callback, error_callback),
+          zip_file_path_(zip_file_path) {
+}
+
+void ListArchiveWorker::Execute() {
+  if (listArchive(zip_file_path_.c_str(), &entries_)) {
+    SetErrorMessage("Error on reading zip file.");
+    return;
+  }
+  size_t names_size = 0;
+  for (const ArchiveEntry& entry : entries_)
+    names_size += entry.name.size();
+  // The name offsets are a Uint32Array.
+  if (!FitsInBuffer(names_size)) {
+    SetErrorMessage("Zip file has too many entries.");
+    return;
+  }
+  names_.reserve(names_size);
+  for (const ArchiveEntry& entry : entries_)
+    names_ += entry.name;
+}
+
+void ListArchiveWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  size_t count = entries_.size();
+  uint32_t* name_offsets_data = nullptr;
+  v8::Local<v8::Uint32Array> name_offsets =
+      utils::NewTypedArray<v8::Uint32Array>(count + 1, &name_offsets_data);
+  double* compressed_sizes_data = nullptr;
+  v8::Local<v8::Float64Array> compressed_sizes =
+      utils::NewTypedArray<v8::Float64Array>(count, &compressed_sizes_data);
+  double* uncompressed_sizes_data = nullptr;
+  v8::Local<v8::Float64Array> uncompressed_sizes =
+      utils::NewTypedArray<v8::Float64Array>(count, &uncompressed_sizes_data);
+  uint32_t* crcs_data = nullptr;
+  v8::Local<v8::Uint32Array> crcs =
+      utils::NewTypedArray<v8::Uint32Array>(count, &crcs_data);
+  uint32_t* dos_dates_data = nullptr;
+  v8::Local<v8::Uint32Array> dos_dates =
+      utils::NewTypedArray<v8::Uint32Array>(count, &dos_dates_data);
+
+  uint32_t name_offset = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const unz_file_info64& info = entries_[i].info;
+    name_offsets_data[i] = name_offset;
+    name_offset += static_cast<uint32_t>(entries_[i].name.size());
+    compressed_sizes_data[i] = static_cast<double>(info.compressed_size);
+    uncompressed_sizes_data[i] = static_cast<double>(info.uncompressed_size);
+    crcs_data[i] = static_cast<uint32_t>(info.crc);
+    dos_dates_data[i] = static_cast<uint32_t>(info.dosDate);
+  }
+  name_offsets_data[count] = name_offset;
+
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("count").ToLocalChecked(),
+           Nan::New(static_cast<uint32_t>(count)));
+  Nan::Set(result, Nan::New("names").ToLocalChecked(),
+           Nan::CopyBuffer(names_.data(), names_.size()).ToLocalChecked());
+  Nan::Set(result, Nan::New("nameOffsets").ToLocalChecked(), name_offsets);
+  Nan::Set(result, Nan::New("compressedSizes").ToLocalChecked(),
+           compressed_sizes);
+  Nan::Set(result, Nan::New("uncompressedSizes").ToLocalChecked(),
+           uncompressed_sizes);
+  Nan::Set(result, Nan::New("crcs").ToLocalChecked(), crcs);
+  Nan::Set(result, Nan::New("dosDates").ToLocalChecked(), dos_dates);
+  v8::Local<v8::Value> argv[] = { result };
+  Nan::AsyncResource resource("greenworks:ListArchiveWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
+}
+
+VerifyArchiveWorker::VerifyArchiveWorker(Nan::Callback* success_callback,
+    Nan::Callback* error_callback, const std::string& zip_file_path,
+    const std::string& password, int threads)
+        : SteamAsyncWorker(success_callback, error_callback),
+          zip_file_path_(zip_file_path),
+          password_(password),
+          threads_(threads) {
+}
+
+void VerifyArchiveWorker::Execute() {
+  UnzipOptions options;
+  options.password = password_.empty() ? nullptr : password_.c_str();
+  options.threads = threads_;
+  if (verifyArchive(zip_file_path_.c_str(), options, &result_))
+    SetErrorMessage("Error on reading zip file.");
+}
+
+void VerifyArchiveWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  v8::Local<v8::Array> corrupt_entries = Nan::New<v8::Array>(
+      static_cast<int>(result_.corrupt_entries.size()));
+  for (size_t i = 0; i < result_.corrupt_entries.size(); ++i) {
+    Nan::Set(corrupt_entries, static_cast<uint32_t>(i),
+             Nan::New(result_.corrupt_entries[i]).ToLocalChecked());
+  }
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("corruptEntries").ToLocalChecked(),
+           corrupt_entries);
+  Nan::Set(result, Nan::New("bytes").ToLocalChecked(),
+           Nan::New(static_cast<double>(result_.bytes)));
+  Nan::Set(result, Nan::New("time").ToLocalChecked(),
+           Nan::New(result_.seconds));
+  Nan::Set(result, Nan::New("bytesPerSecond").ToLocalChecked(),
+           Nan::New(result_.seconds > 0 ? result_.bytes / result_.seconds
+                                        : 0));
+  v8::Local<v8::Value> argv[] = { result };
+  Nan::AsyncResource resource(
+      "greenworks:VerifyArchiveWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
+}
+
+OpenArchiveWorker::OpenArchiveWorker(Nan::Callback* success_callback,
+    Nan::Callback* error_callback, const std::string& zip_file_path,
+    const std::string& password)
+        : SteamAsyncWorker(success_callback, error_callback),
+          zip_file_path_(zip_file_path),
+          password_(password) {
+}
+
+void OpenArchiveWorker::Execute() {
+  int error = 0;
+  reader_ = ArchiveReader::Open(zip_file_path_.c_str(), password_.c_str(),
+                                &error);
+  if (!reader_)
+    SetErrorMessage("Error on opening zip file.");
+}
+
+void OpenArchiveWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  v8::Local<v8::Value> argv[] = { ArchiveHandle::Create(reader_) };
+  Nan::AsyncResource resource("greenworks:OpenArchiveWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
+}
+
+ReadArchiveEntryWorker::ReadArchiveEntryWorker(
+    Nan::Callback* success_callback, Nan::Callback* error_callback,
+    std::shared_ptr<ArchiveReader> reader, const std::string& name)
+        : SteamAsyncWorker(success_callback, error_callback),
+          reader_(reader),
+          name_(name) {
+}
+
+ReadArchiveEntryWorker::~ReadArchiveEntryWorker() {
+  free(entry_.data);
+}
+
+void ReadArchiveEntryWorker::Execute() {
+  int result = reader_->ReadEntry(name_, &entry_);
+  if (result == UNZ_END_OF_LIST_OF_FILE)
+    SetErrorMessage("Entry not found in zip file.");
+  else if (result)
+    SetErrorMessage("Error on reading zip entry.");
+  else if (!FitsInBuffer(entry_.size))
+    SetErrorMessage("Zip entry is too large for a Buffer.");
+}
+
+void ReadArchiveEntryWorker::HandleOKCallback() {
+  Nan::HandleScope scope;
+  // The Buffer takes over the data and frees it with free().
+  v8::Local<v8::Value> argv[] = {
+      Nan::NewBuffer(entry_.data, static_cast<uint32_t>(entry_.size))
+          .ToLocalChecked() };
+  entry_.data = nullptr;
+  Nan::AsyncResource resource(
+      "greenworks:ReadArchiveEntryWorker.HandleOKCallback");
+  callback->Call(1, argv, &resource);
 }
 
 GetAuthSessionTicketWorker::GetAuthSessionTicketWorker(
@@ -300,17 +745,17 @@ GetAuthSessionTicketWorker::GetAuthSessionTicketWorker(
 }
 
 void GetAuthSessionTicketWorker::Execute() {
+  WatchCallback(&result);
   handle_ = SteamUser()->GetAuthSessionTicket(ticket_buf_,
                                               sizeof(ticket_buf_),
                                               &ticket_buf_size_);
-  WaitForCompleted();
 }
 
 void GetAuthSessionTicketWorker::OnGetAuthSessionCompleted(
     GetAuthSessionTicketResponse_t *inCallback) {
   if (inCallback->m_eResult != k_EResultOK)
     SetErrorMessage("Error on getting auth session ticket.");
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void GetAuthSessionTicketWorker::HandleOKCallback() {
@@ -340,7 +785,7 @@ void RequestEncryptedAppTicketWorker::Execute() {
       user_data_.length());
   call_result_.Set(steam_api_call, this,
       &RequestEncryptedAppTicketWorker::OnRequestEncryptedAppTicketCompleted);
-  WaitForCompleted();
+  WatchCallResult(&call_result_, steam_api_call);
 }
 
 void RequestEncryptedAppTicketWorker::OnRequestEncryptedAppTicketCompleted(
@@ -351,7 +796,7 @@ void RequestEncryptedAppTicketWorker::OnRequestEncryptedAppTicketCompleted(
   } else {
     SetErrorMessage("Error on getting encrypted app ticket.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void RequestEncryptedAppTicketWorker::HandleOKCallback() {
@@ -377,13 +822,13 @@ ConsumeItemWorker::ConsumeItemWorker(
 }
 
 void ConsumeItemWorker::Execute() {
+  WatchCallback(&m_SteamInventoryResult);
+
   bool success = SteamInventory()->ConsumeItem(&inv_result_, itemConsume_, unQuantity_);
 
   if (!success) {
     SetErrorMessage("Error - Called from SteamGameServer.");
   }
-
-  WaitForCompleted();
 }
 
 void ConsumeItemWorker::HandleOKCallback() {
@@ -430,7 +875,7 @@ void ConsumeItemWorker::OnSteamInventoryResult( SteamInventoryResultReady_t *cal
     // We're not hanging on the the result after processing it.
 	SteamInventory()->DestroyResult( callback->m_handle );
 
-    is_completed_ = true;
+    SetCompleted();
 }
 
 StartPurchaseWorker::StartPurchaseWorker(
@@ -474,13 +919,13 @@ ExchangeItemsWorker::ExchangeItemsWorker(
 }
 
 void ExchangeItemsWorker::Execute() {
+  WatchCallback(&m_SteamInventoryResult);
+
   bool success = SteamInventory()->ExchangeItems(&inv_result_, pArrayItemDefsGenerate_, punArrayQuantityGenerate_, unArrayLengthGenerate_, pArrayItemInstancesDestroy_, punArrayQuantityDestroy_, unArrayLengthDestroy_);
 
   if(!success) {
     SetErrorMessage("ExchangeItems failed. Items to generate must be exactly 1.");
   }
-
-  WaitForCompleted();
 }
 
 void ExchangeItemsWorker::OnSteamInventoryResult( SteamInventoryResultReady_t *callback ) {
@@ -506,7 +951,7 @@ void ExchangeItemsWorker::OnSteamInventoryResult( SteamInventoryResultReady_t *c
     // We're not hanging on the the result after processing it.
 	SteamInventory()->DestroyResult( callback->m_handle );
 
-    is_completed_ = true;
+    SetCompleted();
 }
 
 void ExchangeItemsWorker::HandleOKCallback() {
@@ -544,13 +989,14 @@ GetAllItemsWorker::GetAllItemsWorker(
 
 //We need this to execute SteamInventory()->GetAllItems.
 void GetAllItemsWorker::Execute() {
+  WatchCallback(&m_SteamInventoryResult);
+  WatchCallback(&m_SteamInventoryFullUpdate);
+
   bool success = SteamInventory()->GetAllItems(&inv_result_);
 
   if (!success) {
     SetErrorMessage("Error - Called from SteamGameServer.");
   }
-
-  WaitForCompleted();
 }
 
 //We need this to pass an argument to our success callback.
@@ -602,7 +1048,7 @@ void GetAllItemsWorker::OnSteamInventoryResult( SteamInventoryResultReady_t *cal
     // We're not hanging on the the result after processing it.
 	SteamInventory()->DestroyResult( callback->m_handle );
 
-    is_completed_ = true;
+    SetCompleted();
 }
 
 }  // namespace greenworks
@@ -5,14 +5,18 @@
 #ifndef SRC_GREENWORKS_ASYNC_WORKERS_H_
 #define SRC_GREENWORKS_ASYNC_WORKERS_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "steam/steam_api.h"
 
 #include "steam_async_worker.h"
+#include "greenworks_archive_progress.h"
+#include "greenworks_unzip.h"
 #include "greenworks_utils.h"
 #include "greenworks_workshop_workers.h"
+#include "greenworks_zip.h"
 
 namespace greenworks {
 
@@ -132,31 +136,82 @@ class GetNumberOfPlayersWorker : public SteamCallbackAsyncWorker {
   CCallResult<GetNumberOfPlayersWorker, NumberOfCurrentPlayers_t> call_result_;
 };
 
-class CreateArchiveWorker : public SteamAsyncWorker {
+// A worker running zip() or unzip(). It can be cancelled through progress(),
+// and while it runs it passes the progress of the call to
+// |progress_callback| (if not null) at most every 100 ms.
+class ArchiveWorker : public SteamAsyncWorker {
+ public:
+  ArchiveWorker(Nan::Callback* success_callback,
+                Nan::Callback* error_callback,
+                Nan::Callback* progress_callback);
+  ~ArchiveWorker() override;
+
+  std::shared_ptr<ArchiveProgress> progress() const { return progress_; }
+
+  void WorkComplete() override;
+
+ protected:
+  // Sets the error message for a zip() or unzip() |result| other than 0.
+  void SetArchiveError(int result, const std::string& message);
+
+ private:
+#if NAUV_UVVERSION < 0x000b17
+  static void OnProgressTimer(uv_timer_t* handle, int status_code);
+#else
+  static void OnProgressTimer(uv_timer_t* handle);
+#endif
+  void ReportProgress();
+
+  std::shared_ptr<ArchiveProgress> progress_;
+  Nan::Callback* progress_callback_;
+  // Deleted once it has been closed, which may be after the worker is gone.
+  uv_timer_t* progress_timer_;
+  ArchiveProgress::Snapshot last_snapshot_;
+  uint64_t last_report_time_;
+};
+
+class CreateArchiveWorker : public ArchiveWorker {
  public:
   CreateArchiveWorker(Nan::Callback* success_callback,
                       Nan::Callback* error_callback,
+                      Nan::Callback* progress_callback,
                       const std::string& zip_file_path,
                       const std::string& source_dir,
                       const std::string& password,
-                      int compress_level);
+                      int compress_level,
+                      int threads,
+                      const std::string& previous_archive,
+                      bool store_incompressible);
 
   void Execute() override;
+  void HandleOKCallback() override;
 
  private:
   std::string zip_file_path_;
   std::string source_dir_;
   std::string password_;
   int compress_level_;
+  int threads_;
+  std::string previous_archive_;
+  bool store_incompressible_;
+  ZipReport report_;
 };
 
-class ExtractArchiveWorker : public SteamAsyncWorker {
+class ExtractArchiveWorker : public ArchiveWorker {
  public:
   ExtractArchiveWorker(Nan::Callback* success_callback,
                        Nan::Callback* error_callback,
+                       Nan::Callback* progress_callback,
                        const std::string& zip_file_path,
                        const std::string& extract_path,
-                       const std::string& password);
+                       const std::string& password,
+                       int threads,
+                       bool skip_unchanged,
+                       bool verify_crc,
+                       const std::string& journal,
+                       bool deduplicate,
+                       bool hardlink_duplicates,
+                       bool verify_duplicates);
 
   void Execute() override;
 
@@ -164,6 +219,140 @@ class ExtractArchiveWorker : public SteamAsyncWorker {
   std::string zip_file_path_;
   std::string extract_path_;
   std::string password_;
+  int threads_;
+  bool skip_unchanged_;
+  bool verify_crc_;
+  std::string journal_;
+  bool deduplicate_;
+  bool hardlink_duplicates_;
+  bool verify_duplicates_;
+};
+
+// Builds an archive in memory, from a directory or from entries added with
+// AddEntry(), and passes it to the success callback as a Buffer.
+class CreateArchiveToBufferWorker : public SteamAsyncWorker {
+ public:
+  CreateArchiveToBufferWorker(Nan::Callback* success_callback,
+                              Nan::Callback* error_callback,
+                              const std::string& source_dir,
+                              const std::string& password,
+                              int compress_level,
+                              int threads);
+  ~CreateArchiveToBufferWorker() override;
+
+  // |data| must stay valid until the worker is done, e.g. by keeping its
+  // Buffer with SaveToPersistent().
+  void AddEntry(const std::string& name, const char* data, size_t size);
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  std::string source_dir_;
+  std::vector<ZipMemoryEntry> entries_;
+  std::string password_;
+  int compress_level_;
+  int threads_;
+  char* archive_data_;
+  size_t archive_size_;
+};
+
+// Extracts an archive held in memory and passes its files to the success
+// callback as an array of {name, data} objects.
+class ExtractArchiveFromBufferWorker : public SteamAsyncWorker {
+ public:
+  // |data| must stay valid until the worker is done.
+  ExtractArchiveFromBufferWorker(Nan::Callback* success_callback,
+                                 Nan::Callback* error_callback,
+                                 const char* data,
+                                 size_t size,
+                                 const std::string& password,
+                                 int threads);
+  ~ExtractArchiveFromBufferWorker() override;
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  const char* data_;
+  size_t size_;
+  std::string password_;
+  int threads_;
+  std::vector<UnzipMemoryEntry> entries_;
+};
+
+// Reads the central directory of an archive and passes its entries to the
+// success callback as columns of typed arrays.
+class ListArchiveWorker : public SteamAsyncWorker {
+ public:
+  ListArchiveWorker(Nan::Callback* success_callback,
+                    Nan::Callback* error_callback,
+                    const std::string& zip_file_path);
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  std::string zip_file_path_;
+  std::vector<ArchiveEntry> entries_;
+  // All names back to back, built on the worker thread.
+  std::string names_;
+};
+
+// Inflates every file of an archive without writing it, and passes the
+// result of the check to the success callback.
+class VerifyArchiveWorker : public SteamAsyncWorker {
+ public:
+  VerifyArchiveWorker(Nan::Callback* success_callback,
+                      Nan::Callback* error_callback,
+                      const std::string& zip_file_path,
+                      const std::string& password,
+                      int threads);
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  std::string zip_file_path_;
+  std::string password_;
+  int threads_;
+  VerifyResult result_;
+};
+
+// Opens and indexes an archive, and passes an ArchiveHandle for it to the
+// success callback.
+class OpenArchiveWorker : public SteamAsyncWorker {
+ public:
+  OpenArchiveWorker(Nan::Callback* success_callback,
+                    Nan::Callback* error_callback,
+                    const std::string& zip_file_path,
+                    const std::string& password);
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  std::string zip_file_path_;
+  std::string password_;
+  std::shared_ptr<ArchiveReader> reader_;
+};
+
+// Inflates a single file of an open archive into a Buffer.
+class ReadArchiveEntryWorker : public SteamAsyncWorker {
+ public:
+  ReadArchiveEntryWorker(Nan::Callback* success_callback,
+                         Nan::Callback* error_callback,
+                         std::shared_ptr<ArchiveReader> reader,
+                         const std::string& name);
+  ~ReadArchiveEntryWorker() override;
+
+  void Execute() override;
+  void HandleOKCallback() override;
+
+ private:
+  std::shared_ptr<ArchiveReader> reader_;
+  std::string name_;
+  UnzipMemoryEntry entry_;
 };
 
 class GetAuthSessionTicketWorker : public SteamCallbackAsyncWorker {
@@ -0,0 +1,449 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "greenworks_batch_writer.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The kernel ABI is used directly, so that neither liburing nor a kernel
+// with io_uring is needed to build. IO_URING_OP_SUPPORTED is only defined
+// by headers (5.6 and later) that also know the opcodes used below.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#define GREENWORKS_IO_URING
+#endif
+
+namespace greenworks {
+
+namespace {
+
+// Files submitted to io_uring per io_uring_enter().
+const unsigned kBatchSize = 64;
+const int kMaxWriterThreads = 4;
+// Write() blocks while more than this is waiting to be written.
+const size_t kMaxQueuedBytes = 8 * 1024 * 1024;
+
+const int kOpenFlags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+bool WriteAll(int fd, const char* data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t written = pwrite(fd, data, size, offset);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+// Best effort, like change_file_date() for other files.
+void StampFile(int fd, time_t mtime) {
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = mtime;
+  times[0].tv_nsec = times[1].tv_nsec = 0;
+  futimens(fd, times);
+}
+
+bool WriteFileNow(const std::string& path, const std::vector<char>& data,
+                  time_t mtime) {
+  int fd = open(path.c_str(), kOpenFlags, 0666);
+  if (fd < 0)
+    return false;
+  bool ok = WriteAll(fd, data.data(), data.size(), 0);
+  if (ok)
+    StampFile(fd, mtime);
+  if (close(fd) != 0)
+    ok = false;
+  return ok;
+}
+
+}  // namespace
+
+#if defined(GREENWORKS_IO_URING)
+
+// A minimal io_uring: entries are added, then submitted and waited for
+// together.
+class BatchFileWriter::Ring {
+ public:
+  // Returns null if io_uring or one of the opcodes used isn't available.
+  static std::unique_ptr<Ring> Create(unsigned entries);
+  ~Ring();
+
+  // Returns a cleared entry to fill in, or null if |entries| are pending
+  // already.
+  io_uring_sqe* Add();
+  // Submits the pending entries and waits for all of them. |results| gets
+  // their results in the order they were added. Returns false if the ring
+  // failed, in which case it must not be used anymore. Even then, every
+  // entry the kernel took has completed on return; the others are
+  // -ECANCELED.
+  bool Run(std::vector<int>* results);
+
+ private:
+  Ring() = default;
+  bool Map();
+
+  int fd_ = -1;
+  io_uring_params params_ = {};
+  void* sq_ring_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = MAP_FAILED;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned cq_mask_ = 0;
+
+  unsigned pending_ = 0;
+};
+
+std::unique_ptr<BatchFileWriter::Ring> BatchFileWriter::Ring::Create(
+    unsigned entries) {
+  std::unique_ptr<Ring> ring(new Ring());
+  ring->fd_ = static_cast<int>(
+      syscall(__NR_io_uring_setup, entries, &ring->params_));
+  if (ring->fd_ < 0 || ring->params_.sq_entries < entries || !ring->Map())
+    return nullptr;
+
+  std::vector<char> probe_buffer(
+      sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+  auto* probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+  if (syscall(__NR_io_uring_register, ring->fd_, IORING_REGISTER_PROBE, probe,
+              256) < 0) {
+    return nullptr;
+  }
+  for (int op : {IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE}) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      return nullptr;
+    }
+  }
+  return ring;
+}
+
+bool BatchFileWriter::Ring::Map() {
+  sq_ring_size_ =
+      params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+  if (params_.features & IORING_FEAT_SINGLE_MMAP)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED)
+    return false;
+  if (params_.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED)
+      return false;
+  }
+  sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED)
+    return false;
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+  return true;
+}
+
+BatchFileWriter::Ring::~Ring() {
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != MAP_FAILED)
+    munmap(sq_ring_, sq_ring_size_);
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+io_uring_sqe* BatchFileWriter::Ring::Add() {
+  if (pending_ == params_.sq_entries)
+    return nullptr;
+  // Only this thread writes the tail; the kernel reads it on submission.
+  unsigned tail = *sq_tail_ + pending_;
+  unsigned index = tail & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = pending_++;
+  sq_array_[index] = index;
+  return sqe;
+}
+
+bool BatchFileWriter::Ring::Run(std::vector<int>* results) {
+  unsigned count = pending_;
+  pending_ = 0;
+  results->assign(count, -ECANCELED);
+  unsigned end = *sq_tail_ + count;
+  __atomic_store_n(sq_tail_, end, __ATOMIC_RELEASE);
+
+  unsigned to_submit = count;
+  unsigned completed = 0;
+  bool failed = false;
+  while (completed < count - to_submit || (!failed && to_submit > 0)) {
+    // The kernel doesn't wait if it couldn't submit everything. Once
+    // submitting failed, the entries it did take are still waited for, as
+    // their buffers and descriptors are in use until they complete.
+    unsigned in_flight = count - to_submit - completed;
+    int ret = static_cast<int>(syscall(
+        __NR_io_uring_enter, fd_, failed ? 0 : to_submit,
+        failed ? in_flight : count - completed, IORING_ENTER_GETEVENTS,
+        nullptr, 0));
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      // On a ring that has worked before, waiting alone can't fail like this.
+      if (failed)
+        break;
+      failed = true;
+    }
+    to_submit = end - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      if (cqe.user_data < count)
+        (*results)[cqe.user_data] = cqe.res;
+      ++completed;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  return !failed;
+}
+
+#else  // !defined(GREENWORKS_IO_URING)
+
+class BatchFileWriter::Ring {
+ public:
+  static std::unique_ptr<Ring> Create(unsigned entries) { return nullptr; }
+};
+
+#endif  // defined(GREENWORKS_IO_URING)
+
+BatchFileWriter::BatchFileWriter(int threads)
+    : ring_(Ring::Create(kBatchSize)),
+      queued_bytes_(0),
+      in_flight_(0),
+      error_(false),
+      stopping_(false) {
+  if (ring_) {
+    threads_.emplace_back(&BatchFileWriter::RunRing, this);
+    return;
+  }
+  threads = std::max(1, std::min(threads, kMaxWriterThreads));
+  for (int i = 0; i < threads; ++i)
+    threads_.emplace_back(&BatchFileWriter::RunThread, this);
+}
+
+BatchFileWriter::~BatchFileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  for (std::thread& thread : threads_)
+    thread.join();
+}
+
+void BatchFileWriter::Write(const std::string& path, std::vector<char> data,
+                            time_t mtime) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] {
+      return queued_bytes_ == 0 || queued_bytes_ < kMaxQueuedBytes;
+    });
+    queued_bytes_ += data.size();
+    queue_.push_back(File{path, std::move(data), mtime});
+  }
+  changed_.notify_all();
+}
+
+bool BatchFileWriter::Finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return queue_.empty() && in_flight_ == 0; });
+  bool ok = !error_;
+  error_ = false;
+  return ok;
+}
+
+bool BatchFileWriter::TakeFiles(size_t max_files, std::vector<File>* files) {
+  files->clear();
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+  // Whatever has queued up while the previous batch was written goes into
+  // the next one, so batches grow when writing is the bottleneck.
+  while (!queue_.empty() && files->size() < max_files) {
+    files->push_back(std::move(queue_.front()));
+    queue_.pop_front();
+  }
+  in_flight_ += files->size();
+  return !files->empty();
+}
+
+void BatchFileWriter::DoneFiles(const std::vector<File>& files, bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const File& file : files)
+      queued_bytes_ -= file.data.size();
+    in_flight_ -= files.size();
+    if (!ok)
+      error_ = true;
+  }
+  changed_.notify_all();
+}
+
+void BatchFileWriter::RunThread() {
+  std::vector<File> files;
+  while (TakeFiles(1, &files)) {
+    const File& file = files.front();
+    DoneFiles(files, WriteFileNow(file.path, file.data, file.mtime));
+  }
+}
+
+#if defined(GREENWORKS_IO_URING)
+
+void BatchFileWriter::RunRing() {
+  std::vector<File> files;
+  std::vector<int> fds;
+  std::vector<int> results;
+  // Bytes of each file the ring wrote, or a negative error.
+  std::vector<int> written;
+  // Files of the current step, in the order their entries were added.
+  std::vector<size_t> step_files;
+  bool ring_failed = false;
+  while (TakeFiles(kBatchSize, &files)) {
+    bool ok = true;
+    if (ring_failed) {
+      for (const File& file : files)
+        ok = WriteFileNow(file.path, file.data, file.mtime) && ok;
+      DoneFiles(files, ok);
+      continue;
+    }
+
+    for (const File& file : files) {
+      io_uring_sqe* sqe = ring_->Add();
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uintptr_t>(file.path.c_str());
+      sqe->len = 0666;
+      sqe->open_flags = kOpenFlags;
+    }
+    if (!ring_->Run(&fds))
+      ring_failed = true;
+
+    // From here on, whatever the ring didn't do is done directly.
+    step_files.clear();
+    written.assign(files.size(), 0);
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (fds[i] < 0) {
+        if (fds[i] == -ECANCELED)
+          ok = WriteFileNow(files[i].path, files[i].data, files[i].mtime) && ok;
+        else
+          ok = false;
+        continue;
+      }
+      if (files[i].data.empty() || ring_failed)
+        continue;
+      io_uring_sqe* sqe = ring_->Add();
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = fds[i];
+      sqe->addr = reinterpret_cast<uintptr_t>(files[i].data.data());
+      sqe->len = static_cast<unsigned>(files[i].data.size());
+      sqe->off = 0;
+      step_files.push_back(i);
+    }
+    if (!step_files.empty() && !ring_->Run(&results))
+      ring_failed = true;
+    for (size_t j = 0; j < step_files.size(); ++j)
+      written[step_files[j]] = results[j] == -ECANCELED ? 0 : results[j];
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (fds[i] < 0)
+        continue;
+      const File& file = files[i];
+      // Short writes are finished directly too.
+      if (written[i] < 0 ||
+          !WriteAll(fds[i], file.data.data() + written[i],
+                    file.data.size() - written[i], written[i])) {
+        ok = false;
+      }
+      // io_uring has no opcode to set file times, so this one is a syscall
+      // per file. It must come after the write, which updates the time.
+      StampFile(fds[i], file.mtime);
+    }
+
+    step_files.clear();
+    for (size_t i = 0; i < files.size() && !ring_failed; ++i) {
+      if (fds[i] < 0)
+        continue;
+      io_uring_sqe* sqe = ring_->Add();
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->fd = fds[i];
+      step_files.push_back(i);
+    }
+    if (!step_files.empty() && !ring_->Run(&results))
+      ring_failed = true;
+    // Descriptors the ring closed must not be closed again: another thread
+    // may have been given the same number since.
+    std::vector<bool> closed(files.size(), false);
+    for (size_t j = 0; j < step_files.size(); ++j) {
+      if (results[j] == -ECANCELED)
+        continue;
+      closed[step_files[j]] = true;
+      if (results[j] < 0)
+        ok = false;
+    }
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (fds[i] >= 0 && !closed[i] && close(fds[i]) != 0)
+        ok = false;
+    }
+    DoneFiles(files, ok);
+  }
+}
+
+#else  // !defined(GREENWORKS_IO_URING)
+
+void BatchFileWriter::RunRing() {}
+
+#endif  // defined(GREENWORKS_IO_URING)
+
+}  // namespace greenworks
+
+#endif  // _WIN32
@@ -0,0 +1,77 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_GREENWORKS_BATCH_WRITER_H_
+#define SRC_GREENWORKS_BATCH_WRITER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace greenworks {
+
+// Files up to this size are inflated into memory and written by a
+// BatchFileWriter. For them, opening, closing and stamping the file costs
+// more than writing it.
+const uint64_t kBatchMaxFileSize = 16 * 1024;
+
+// Creates many small files off the calling threads. On Linux, the files are
+// opened, written and closed in batches through io_uring, with one
+// io_uring_enter() per step for up to 64 files. Where io_uring isn't
+// available (older kernels, seccomp filters, other platforms), a few writer
+// threads create the files one by one instead.
+//
+// Not available on Windows, where the files are written directly.
+class BatchFileWriter {
+ public:
+  // |threads| is the number of writer threads if io_uring can't be used.
+  explicit BatchFileWriter(int threads);
+  ~BatchFileWriter();
+
+  // Queues |data| to be written to |path|, which is created or truncated,
+  // and stamped with |mtime|. Blocks while too much data is queued already.
+  void Write(const std::string& path, std::vector<char> data, time_t mtime);
+  // Waits for all queued files. Returns false if any of them couldn't be
+  // written since the last call. The writer can be used again afterwards.
+  bool Finish();
+
+  bool UsesIoUring() const { return ring_ != nullptr; }
+
+ private:
+  struct File {
+    std::string path;
+    std::vector<char> data;
+    time_t mtime;
+  };
+  class Ring;
+
+  // Takes up to |max_files| queued files. Returns false once the writer is
+  // being destroyed and nothing is left.
+  bool TakeFiles(size_t max_files, std::vector<File>* files);
+  void DoneFiles(const std::vector<File>& files, bool ok);
+  void RunRing();
+  void RunThread();
+
+  std::unique_ptr<Ring> ring_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<File> queue_;
+  size_t queued_bytes_;
+  // Files taken by a writer but not done yet.
+  size_t in_flight_;
+  bool error_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_GREENWORKS_BATCH_WRITER_H_
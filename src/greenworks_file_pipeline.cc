@@ -0,0 +1,194 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "greenworks_file_pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+namespace greenworks {
+
+namespace {
+
+// The buffers are aligned to pages, which lets the kernel and memcpy() copy
+// them whole words and pages at a time.
+const uintptr_t kPageSize = 4096;
+
+}  // namespace
+
+BufferPair::BufferPair() : finished_(false), closed_(false) {
+  for (Buffer& buffer : buffers_) {
+    buffer.storage.resize(kPipelineBufferSize + kPageSize - 1);
+    uintptr_t address = reinterpret_cast<uintptr_t>(buffer.storage.data());
+    buffer.data = buffer.storage.data() +
+                  (kPageSize - address % kPageSize) % kPageSize;
+    buffer.size = 0;
+    empty_.push_back(&buffer);
+  }
+}
+
+BufferPair::Buffer* BufferPair::AcquireEmpty() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] { return closed_ || !empty_.empty(); });
+  if (closed_)
+    return nullptr;
+  Buffer* buffer = empty_.front();
+  empty_.pop_front();
+  return buffer;
+}
+
+void BufferPair::PushFilled(Buffer* buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filled_.push_back(buffer);
+  }
+  changed_.notify_all();
+}
+
+void BufferPair::Finish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+  }
+  changed_.notify_all();
+}
+
+BufferPair::Buffer* BufferPair::AcquireFilled() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this] {
+    return closed_ || finished_ || !filled_.empty();
+  });
+  if (closed_ || filled_.empty())
+    return nullptr;
+  Buffer* buffer = filled_.front();
+  filled_.pop_front();
+  return buffer;
+}
+
+void BufferPair::Release(Buffer* buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    empty_.push_back(buffer);
+  }
+  changed_.notify_all();
+}
+
+void BufferPair::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  changed_.notify_all();
+}
+
+PipelinedReader::PipelinedReader(FILE* file)
+    : file_(file), current_(nullptr), error_(false) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+  // Lets the kernel read ahead further than it would by default.
+  posix_fadvise(fileno(file_), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  thread_ = std::thread(&PipelinedReader::Run, this);
+}
+
+PipelinedReader::~PipelinedReader() {
+  buffers_.Close();
+  thread_.join();
+}
+
+void PipelinedReader::Run() {
+  while (BufferPair::Buffer* buffer = buffers_.AcquireEmpty()) {
+    buffer->size = fread(buffer->data, 1, kPipelineBufferSize, file_);
+    bool done = buffer->size < kPipelineBufferSize;
+    // Published to the consumer by PushFilled().
+    if (done && ferror(file_))
+      error_ = true;
+    buffers_.PushFilled(buffer);
+    if (done)
+      break;
+  }
+  buffers_.Finish();
+}
+
+bool PipelinedReader::Next(const char** data, size_t* size) {
+  if (current_)
+    buffers_.Release(current_);
+  current_ = buffers_.AcquireFilled();
+  if (current_ == nullptr) {
+    *data = nullptr;
+    *size = 0;
+    return !error_;
+  }
+  *data = current_->data;
+  *size = current_->size;
+  // A short read that failed is reported with the data before it.
+  return current_->size > 0 || !error_;
+}
+
+PipelinedWriter::PipelinedWriter(FILE* file, uint64_t expected_size)
+    : file_(file), current_(nullptr), error_(false) {
+#if defined(__linux__)
+  // Best effort: fails with EOPNOTSUPP where the file system doesn't support
+  // it. Unlike posix_fallocate(), it doesn't fall back to writing zeros.
+  if (expected_size > 0) {
+    fallocate(fileno(file_), 0, 0, static_cast<off_t>(expected_size));
+  }
+#endif
+  thread_ = std::thread(&PipelinedWriter::Run, this);
+}
+
+PipelinedWriter::~PipelinedWriter() {
+  if (thread_.joinable()) {
+    buffers_.Close();
+    thread_.join();
+  }
+}
+
+void PipelinedWriter::Run() {
+  while (BufferPair::Buffer* buffer = buffers_.AcquireFilled()) {
+    if (fwrite(buffer->data, 1, buffer->size, file_) != buffer->size) {
+      error_ = true;
+      buffers_.Close();
+      return;
+    }
+    buffers_.Release(buffer);
+  }
+}
+
+bool PipelinedWriter::Write(const char* data, size_t size) {
+  while (size > 0) {
+    if (current_ == nullptr) {
+      current_ = buffers_.AcquireEmpty();
+      // The writer thread hit an error.
+      if (current_ == nullptr)
+        return false;
+      current_->size = 0;
+    }
+    size_t chunk = std::min(size, kPipelineBufferSize - current_->size);
+    memcpy(current_->data + current_->size, data, chunk);
+    current_->size += chunk;
+    data += chunk;
+    size -= chunk;
+    if (current_->size == kPipelineBufferSize) {
+      buffers_.PushFilled(current_);
+      current_ = nullptr;
+    }
+  }
+  return true;
+}
+
+bool PipelinedWriter::Finish() {
+  if (current_ && current_->size > 0) {
+    buffers_.PushFilled(current_);
+    current_ = nullptr;
+  }
+  buffers_.Finish();
+  thread_.join();
+  return !error_ && fflush(file_) == 0;
+}
+
+}  // namespace greenworks
@@ -0,0 +1,112 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_GREENWORKS_FILE_PIPELINE_H_
+#define SRC_GREENWORKS_FILE_PIPELINE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace greenworks {
+
+// Size of the buffers the pipelines below move data in.
+const size_t kPipelineBufferSize = 2 * 1024 * 1024;
+// Files smaller than this are read and written directly; a thread doesn't
+// pay off for them.
+const uint64_t kPipelineMinFileSize = 8 * 1024 * 1024;
+
+// Two buffers passed back and forth between a producer and a consumer
+// thread, so one can be filled while the other is drained.
+class BufferPair {
+ public:
+  struct Buffer {
+    // kPipelineBufferSize bytes, page aligned within |storage|.
+    char* data;
+    size_t size;
+    std::vector<char> storage;
+  };
+
+  BufferPair();
+
+  // Producer: blocks until a buffer is free. Returns null once Close() was
+  // called.
+  Buffer* AcquireEmpty();
+  void PushFilled(Buffer* buffer);
+  // No more buffers will be pushed.
+  void Finish();
+
+  // Consumer: blocks until a buffer was pushed. Returns null once all
+  // buffers have been taken after Finish(), or after Close().
+  Buffer* AcquireFilled();
+  void Release(Buffer* buffer);
+  // Stops the producer, e.g. after an error.
+  void Close();
+
+ private:
+  Buffer buffers_[2];
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<Buffer*> empty_;
+  std::deque<Buffer*> filled_;
+  bool finished_;
+  bool closed_;
+};
+
+// Reads |file| on a separate thread, one buffer ahead of the caller.
+class PipelinedReader {
+ public:
+  // |file| must stay open until the reader is destroyed.
+  explicit PipelinedReader(FILE* file);
+  ~PipelinedReader();
+
+  // Points |data| at the next |size| bytes of the file, valid until the
+  // next call. |size| is 0 at the end of the file. Returns false if the
+  // file couldn't be read.
+  bool Next(const char** data, size_t* size);
+
+ private:
+  void Run();
+
+  FILE* file_;
+  BufferPair buffers_;
+  BufferPair::Buffer* current_;
+  bool error_;
+  std::thread thread_;
+};
+
+// Writes to |file| on a separate thread, so that the caller can produce the
+// next buffer in the meantime.
+class PipelinedWriter {
+ public:
+  // Reserves |expected_size| bytes for |file| up front where the platform
+  // allows it, so it isn't grown (and fragmented) write by write. |file|
+  // must stay open until the writer is destroyed.
+  PipelinedWriter(FILE* file, uint64_t expected_size);
+  ~PipelinedWriter();
+
+  bool Write(const char* data, size_t size);
+  // Writes what is left and waits for it. Returns false if any write
+  // failed.
+  bool Finish();
+
+ private:
+  void Run();
+
+  FILE* file_;
+  BufferPair buffers_;
+  BufferPair::Buffer* current_;
+  // Written by the writer thread, read after it has been joined.
+  bool error_;
+  std::thread thread_;
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_GREENWORKS_FILE_PIPELINE_H_
@@ -0,0 +1,157 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "greenworks_memory_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace greenworks {
+
+namespace {
+
+const size_t kMinCapacity = 64 * 1024;
+
+}  // namespace
+
+struct MemoryFile::Stream {
+  MemoryFile* file;
+  ZPOS64_T position;
+};
+
+MemoryFile::MemoryFile()
+    : data_(nullptr), size_(0), capacity_(0), writable_(true) {}
+
+MemoryFile::MemoryFile(const char* data, size_t size)
+    : data_(const_cast<char*>(data)),
+      size_(size),
+      capacity_(size),
+      writable_(false) {}
+
+MemoryFile::~MemoryFile() {
+  if (writable_)
+    free(data_);
+}
+
+void MemoryFile::FillFileFunc(zlib_filefunc64_def* def) {
+  def->zopen64_file = &MemoryFile::Open;
+  def->zread_file = &MemoryFile::Read;
+  def->zwrite_file = &MemoryFile::Write;
+  def->ztell64_file = &MemoryFile::Tell;
+  def->zseek64_file = &MemoryFile::Seek;
+  def->zclose_file = &MemoryFile::Close;
+  def->zerror_file = &MemoryFile::TestError;
+  def->opaque = this;
+}
+
+char* MemoryFile::Release(size_t* size) {
+  *size = size_;
+  if (!writable_)
+    return nullptr;
+  char* data = data_;
+  if (size_ > 0 && size_ < capacity_) {
+    // Give back the slack left by growing the buffer.
+    char* trimmed = static_cast<char*>(realloc(data_, size_));
+    if (trimmed)
+      data = trimmed;
+  }
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+  return data;
+}
+
+bool MemoryFile::Reserve(size_t capacity) {
+  if (capacity <= capacity_)
+    return true;
+  size_t new_capacity = std::max(capacity, std::max(capacity_ * 2,
+                                                    kMinCapacity));
+  char* data = static_cast<char*>(realloc(data_, new_capacity));
+  if (!data)
+    return false;
+  data_ = data;
+  capacity_ = new_capacity;
+  return true;
+}
+
+voidpf ZCALLBACK MemoryFile::Open(voidpf opaque, const void* filename,
+                                  int mode) {
+  auto* file = static_cast<MemoryFile*>(opaque);
+  if ((mode & ZLIB_FILEFUNC_MODE_CREATE) != 0) {
+    if (!file->writable_)
+      return nullptr;
+    file->size_ = 0;
+  }
+  return new Stream{file, 0};
+}
+
+uLong ZCALLBACK MemoryFile::Read(voidpf opaque, voidpf stream, void* buf,
+                                 uLong size) {
+  auto* s = static_cast<Stream*>(stream);
+  MemoryFile* file = s->file;
+  if (s->position >= file->size_)
+    return 0;
+  uLong length = static_cast<uLong>(
+      std::min<ZPOS64_T>(size, file->size_ - s->position));
+  memcpy(buf, file->data_ + s->position, length);
+  s->position += length;
+  return length;
+}
+
+uLong ZCALLBACK MemoryFile::Write(voidpf opaque, voidpf stream,
+                                  const void* buf, uLong size) {
+  auto* s = static_cast<Stream*>(stream);
+  MemoryFile* file = s->file;
+  if (!file->writable_)
+    return 0;
+  ZPOS64_T end = s->position + size;
+  if (end > SIZE_MAX || !file->Reserve(static_cast<size_t>(end)))
+    return 0;
+  memcpy(file->data_ + s->position, buf, size);
+  s->position = end;
+  file->size_ = std::max(file->size_, static_cast<size_t>(end));
+  return size;
+}
+
+ZPOS64_T ZCALLBACK MemoryFile::Tell(voidpf opaque, voidpf stream) {
+  return static_cast<Stream*>(stream)->position;
+}
+
+long ZCALLBACK MemoryFile::Seek(voidpf opaque, voidpf stream,  // NOLINT
+                                ZPOS64_T offset, int origin) {
+  auto* s = static_cast<Stream*>(stream);
+  ZPOS64_T base = 0;
+  switch (origin) {
+    case ZLIB_FILEFUNC_SEEK_SET:
+      base = 0;
+      break;
+    case ZLIB_FILEFUNC_SEEK_CUR:
+      base = s->position;
+      break;
+    case ZLIB_FILEFUNC_SEEK_END:
+      base = s->file->size_;
+      break;
+    default:
+      return -1;
+  }
+  // Negative offsets wrap around, like they do in minizip's own callbacks.
+  ZPOS64_T position = base + offset;
+  if (position > s->file->size_)
+    return -1;
+  s->position = position;
+  return 0;
+}
+
+int ZCALLBACK MemoryFile::Close(voidpf opaque, voidpf stream) {
+  delete static_cast<Stream*>(stream);
+  return 0;
+}
+
+int ZCALLBACK MemoryFile::TestError(voidpf opaque, voidpf stream) {
+  return 0;
+}
+
+}  // namespace greenworks
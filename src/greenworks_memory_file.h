@@ -0,0 +1,62 @@
+// Copyright (c) 2016 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_GREENWORKS_MEMORY_FILE_H_
+#define SRC_GREENWORKS_MEMORY_FILE_H_
+
+#include <cstddef>
+
+#include "zlib/contrib/minizip/ioapi.h"
+
+namespace greenworks {
+
+// A file in memory that minizip reads and writes through its
+// zlib_filefunc64_def callbacks, so archives can be built and read without
+// touching the disk.
+class MemoryFile {
+ public:
+  // An empty file to write an archive to.
+  MemoryFile();
+  // A read-only file over |data|, which must outlive it.
+  MemoryFile(const char* data, size_t size);
+  ~MemoryFile();
+
+  // Points |def| at this file. Every open through |def| gets its own
+  // position, so several unzFile handles may read the file concurrently.
+  // Only one handle may write to it at a time.
+  void FillFileFunc(zlib_filefunc64_def* def);
+
+  // Hands the written data over to the caller, who frees it with free().
+  // The file is empty afterwards. Returns null for read-only files, and may
+  // return null for an empty file.
+  char* Release(size_t* size);
+
+ private:
+  struct Stream;
+
+  static voidpf ZCALLBACK Open(voidpf opaque, const void* filename, int mode);
+  static uLong ZCALLBACK Read(voidpf opaque, voidpf stream, void* buf,
+                              uLong size);
+  static uLong ZCALLBACK Write(voidpf opaque, voidpf stream, const void* buf,
+                               uLong size);
+  static ZPOS64_T ZCALLBACK Tell(voidpf opaque, voidpf stream);
+  static long ZCALLBACK Seek(voidpf opaque, voidpf stream,  // NOLINT
+                             ZPOS64_T offset, int origin);
+  static int ZCALLBACK Close(voidpf opaque, voidpf stream);
+  static int ZCALLBACK TestError(voidpf opaque, voidpf stream);
+
+  bool Reserve(size_t capacity);
+
+  char* data_;
+  size_t size_;
+  size_t capacity_;
+  bool writable_;
+
+  MemoryFile(const MemoryFile&) = delete;
+  MemoryFile& operator=(const MemoryFile&) = delete;
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_GREENWORKS_MEMORY_FILE_H_
@@ -18,6 +18,24 @@
 
 #include "greenworks_unzip.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "greenworks_batch_writer.h"
+#include "greenworks_file_pipeline.h"
+#include "greenworks_memory_file.h"
 #include "zlib/contrib/minizip/unzip.h"
 #include "zlib/zlib.h"
 
@@ -46,6 +64,7 @@
 #ifdef _WIN32
   #include <direct.h>
   #include <io.h>
+  #include <sys/stat.h>
 #else
   #include <unistd.h>
   #include <utime.h>
@@ -53,8 +72,17 @@
   #include <sys/types.h>
 #endif
 
+#if defined(__linux__)
+  #include <sys/ioctl.h>
+  #ifndef FICLONE
+    #define FICLONE _IOW(0x94, 9, int)
+  #endif
+#elif defined(__APPLE__)
+  #include <sys/clonefile.h>
+#endif
+
 #define CASESENSITIVITY (0)
-#define WRITEBUFFERSIZE (8192)
+#define WRITEBUFFERSIZE (64 * 1024)
 #define MAXFILENAME (256)
 
 #ifdef _WIN32
@@ -64,6 +92,24 @@
 
 namespace {
 
+#ifndef _WIN32
+// The local time of |tmu_date|, as stored by zip tools.
+time_t ToTime(const tm_unz& tmu_date) {
+  struct tm newdate;
+  newdate.tm_sec = tmu_date.tm_sec;
+  newdate.tm_min = tmu_date.tm_min;
+  newdate.tm_hour = tmu_date.tm_hour;
+  newdate.tm_mday = tmu_date.tm_mday;
+  newdate.tm_mon = tmu_date.tm_mon;
+  if (tmu_date.tm_year > 1900)
+    newdate.tm_year = tmu_date.tm_year - 1900;
+  else
+    newdate.tm_year = tmu_date.tm_year;
+  newdate.tm_isdst = -1;
+  return mktime(&newdate);
+}
+#endif
+
 /* change_file_date : change the date/time of a file
 filename : the filename of the file where date/time must be modified
 dosdate : the new date at the MSDos format (4 bytes)
@@ -81,19 +127,7 @@ void change_file_date(const char *filename, uLong dosdate, tm_unz tmu_date) {
   CloseHandle(hFile);
 #else
   struct utimbuf ut;
-  struct tm newdate;
-  newdate.tm_sec = tmu_date.tm_sec;
-  newdate.tm_min = tmu_date.tm_min;
-  newdate.tm_hour = tmu_date.tm_hour;
-  newdate.tm_mday = tmu_date.tm_mday;
-  newdate.tm_mon = tmu_date.tm_mon;
-  if (tmu_date.tm_year > 1900)
-    newdate.tm_year = tmu_date.tm_year - 1900;
-  else
-    newdate.tm_year = tmu_date.tm_year;
-  newdate.tm_isdst = -1;
-
-  ut.actime = ut.modtime = mktime(&newdate);
+  ut.actime = ut.modtime = ToTime(tmu_date);
   utime(filename, &ut);
 #endif
 }
@@ -108,157 +142,657 @@ int mymkdir(const char* dirname) {
   return ret;
 }
 
-int makedir(const char *newdir) {
-  char *buffer;
-  char *p;
-  auto len = (int)strlen(newdir);
-
-  if (len <= 0)
-    return 0;
-
-  buffer = (char*)malloc(len + 1);
-  if (buffer == nullptr)
-    return UNZ_INTERNALERROR;
-  strcpy(buffer, newdir);
-
-  if (buffer[len - 1] == '/')
-    buffer[len - 1] = '\0';
-
-  if (mymkdir(buffer) == 0) {
-    free(buffer);
-    return 1;
+// Directories created or found to exist during one extraction, so that each
+// of them costs a single mkdir() however many entries it holds.
+class DirectoryCache {
+ public:
+  // Creates |path| and any missing parents. Returns false if it can't.
+  bool Create(const std::string& path);
+  bool Contains(const std::string& path) const {
+    return known_.count(path) != 0;
   }
 
-  p = buffer + 1;
-  while (1) {
-    char hold;
+ private:
+  std::unordered_set<std::string> known_;
+};
 
-    while (*p && *p != '\\' && *p != '/')
-      p++;
-    hold = *p;
-    *p = 0;
-    if ((mymkdir(buffer) == -1) && (errno == ENOENT)) {
-      free(buffer);
-      return 0;
+bool DirectoryCache::Create(const std::string& path) {
+  if (path.empty() || Contains(path))
+    return true;
+  if (mymkdir(path.c_str()) != 0 && errno == ENOENT) {
+    size_t end = path.find_last_of("/\\");
+    if (end == std::string::npos || end == 0 ||
+        !Create(path.substr(0, end)) ||
+        (mymkdir(path.c_str()) != 0 && errno == ENOENT)) {
+      return false;
     }
-    if (hold == 0)
-      break;
-    *p++ = hold;
   }
-  free(buffer);
-  return 1;
+  // Other errors mostly mean that it exists already. If it's a file,
+  // extracting to it fails later.
+  known_.insert(path);
+  return true;
 }
 
-int do_extract_currentfile(unzFile uf, const int* popt_extract_without_path,
-    int* popt_overwrite, const char* password) {
-  char filename_inzip[256];
-  char* filename_withoutpath;
-  char* p;
-  FILE *fout = nullptr;
-  void* buf;
+using greenworks::ArchiveEntry;
+
+unzFile OpenArchive(const char* zipfilename) {
+  char filename_try[MAXFILENAME + 16] = "";
+  unzFile uf = nullptr;
+#ifdef USEWIN32IOAPI
+  zlib_filefunc64_def ffunc;
+  fill_win32_filefunc64A(&ffunc);
+#endif
 
-  unz_file_info64 file_info;
-  int err = unzGetCurrentFileInfo64(uf, &file_info, filename_inzip,
-      sizeof(filename_inzip), nullptr, 0, nullptr, 0);
+  strncpy(filename_try, zipfilename, MAXFILENAME - 1);
+  //strncpy doesnt append the trailing NULL, of the string is too long.
+  filename_try[MAXFILENAME] = '\0';
+
+#ifdef USEWIN32IOAPI
+  uf = unzOpen2_64(zipfilename, &ffunc);
+#else
+  uf = unzOpen64(zipfilename);
+#endif
+  if (uf == nullptr) {
+    strcat(filename_try, ".zip");
+#ifdef USEWIN32IOAPI
+    uf = unzOpen2_64(filename_try, &ffunc);
+#else
+    uf = unzOpen64(filename_try);
+#endif
+  }
+  return uf;
+}
 
+// Reads the whole central directory of |uf| in one pass.
+int ReadArchiveEntries(unzFile uf, std::vector<ArchiveEntry>* entries) {
+  unz_global_info64 gi;
+  int err = unzGetGlobalInfo64(uf, &gi);
   if (err != UNZ_OK)
     return err;
+  entries->reserve(gi.number_entry);
 
-  uInt size_buf = WRITEBUFFERSIZE;
-  buf = (void*)malloc(size_buf);
-  if (buf == nullptr)
-    return UNZ_INTERNALERROR;
-
-  p = filename_withoutpath = filename_inzip;
-  while ((*p) != '\0') {
-    if (((*p) == '/') || ((*p) == '\\')) {
+  // Most names fit, so the info and the name usually come in one call.
+  std::vector<char> name(MAXFILENAME);
+  for (err = unzGoToFirstFile(uf); err == UNZ_OK; err = unzGoToNextFile(uf)) {
+    ArchiveEntry entry;
+    err = unzGetCurrentFileInfo64(uf, &entry.info, name.data(), name.size(),
+                                  nullptr, 0, nullptr, 0);
+    if (err == UNZ_OK && entry.info.size_filename > name.size()) {
+      name.resize(entry.info.size_filename);
+      err = unzGetCurrentFileInfo64(uf, nullptr, name.data(), name.size(),
+                                    nullptr, 0, nullptr, 0);
+    }
+    if (err != UNZ_OK)
+      return err;
+    entry.name.assign(name.data(), entry.info.size_filename);
 #ifndef _WIN32
-      (*p) = '/';
+    std::replace(entry.name.begin(), entry.name.end(), '\\', '/');
 #endif
-      filename_withoutpath = p + 1;
-    }
-    p++;
+    entry.offset = unzGetOffset64(uf);
+    entries->push_back(entry);
   }
+  return err == UNZ_END_OF_LIST_OF_FILE ? UNZ_OK : err;
+}
+
+int GetThreadCount(const greenworks::UnzipOptions& options) {
+  if (options.threads > 0)
+    return options.threads;
+  return std::max(1u, std::thread::hardware_concurrency());
+}
 
-  if ((*filename_withoutpath) == '\0') {
-    if ((*popt_extract_without_path) == 0)
-      mymkdir(filename_inzip);
+bool IsDirectoryEntry(const ArchiveEntry& entry) {
+  return !entry.name.empty() &&
+         (entry.name.back() == '/' || entry.name.back() == '\\');
+}
+
+// Drops all but the last of several entries with the same name, which is the
+// one a serial extraction leaves on disk. Entries extracted by different
+// threads must not write the same file.
+void RemoveShadowedEntries(std::vector<ArchiveEntry>* entries) {
+  std::unordered_map<std::string, size_t> last_entries;
+  for (size_t i = 0; i < entries->size(); ++i)
+    last_entries[(*entries)[i].name] = i;
+  if (last_entries.size() == entries->size())
+    return;
+  size_t kept = 0;
+  for (size_t i = 0; i < entries->size(); ++i) {
+    if (last_entries[(*entries)[i].name] == i)
+      (*entries)[kept++] = std::move((*entries)[i]);
   }
-  else {
-    const char* write_filename;
-    if ((*popt_extract_without_path) == 0)
-      write_filename = filename_inzip;
-    else
-      write_filename = filename_withoutpath;
+  entries->resize(kept);
+}
 
-    err = unzOpenCurrentFilePassword(uf, password);
-    if (err == UNZ_OK) {
-      fout = fopen64(write_filename, "wb");
-
-      /* some zipfile don't contain directory alone before file */
-      if ((fout == nullptr) && ((*popt_extract_without_path) == 0) &&
-        (filename_withoutpath != (char*)filename_inzip))
-      {
-        char c = *(filename_withoutpath - 1);
-        *(filename_withoutpath - 1) = '\0';
-        makedir(write_filename);
-        *(filename_withoutpath - 1) = c;
-        fout = fopen64(write_filename, "wb");
-      }
+std::string JoinPath(const std::string& dir, const std::string& name) {
+  if (dir.empty())
+    return name;
+#ifdef _WIN32
+  return dir + "\\" + name;
+#else
+  return dir + "/" + name;
+#endif
+}
+
+// Creates |dirname| and every directory the entries will be extracted to,
+// from the central directory, so extraction threads never have to.
+int CreateDirectories(const std::vector<ArchiveEntry>& entries,
+                      const std::string& dirname) {
+  DirectoryCache directories;
+  if (!directories.Create(dirname))
+    return UNZ_ERRNO;
+  for (const ArchiveEntry& entry : entries) {
+    size_t end = IsDirectoryEntry(entry) ? entry.name.size() - 1
+                                         : entry.name.find_last_of("/\\");
+    if (end == std::string::npos || end == 0 ||
+        directories.Contains(JoinPath(dirname, entry.name.substr(0, end)))) {
+      continue;
     }
+    // Parents first, so that no mkdir() fails for a missing parent.
+    size_t next = 0;
+    do {
+      next = entry.name.find_first_of("/\\", next + 1);
+      if (next == std::string::npos || next > end)
+        next = end;
+      if (!directories.Create(JoinPath(dirname, entry.name.substr(0, next))))
+        return UNZ_ERRNO;
+    } while (next < end);
+  }
+  return UNZ_OK;
+}
 
-    if (fout != nullptr) {
-      do {
-        err = unzReadCurrentFile(uf, buf, size_buf);
-        if (err<0)
-          break;
-        if (err>0)
-          if (fwrite(buf, err, 1, fout) != 1) {
-            err = UNZ_ERRNO;
-            break;
-          }
-      } while (err>0);
-      if (fout)
-        fclose(fout);
+// Small files are handed to |batch_writer| if it isn't null.
+int ExtractEntry(unzFile uf, const ArchiveEntry& entry,
+                 const std::string& dirname, const char* password,
+                 greenworks::ArchiveProgress* progress,
+                 greenworks::BatchFileWriter* batch_writer, void* buf,
+                 uInt size_buf) {
+  if (IsDirectoryEntry(entry))
+    return UNZ_OK;
 
-      if (err == 0)
-        change_file_date(write_filename, file_info.dosDate,
-        file_info.tmu_date);
-    }
+  int err = unzSetOffset64(uf, entry.offset);
+  if (err != UNZ_OK)
+    return err;
+  err = unzOpenCurrentFilePassword(uf, password);
+  if (err != UNZ_OK)
+    return err;
 
+  std::string write_filename = JoinPath(dirname, entry.name);
+#ifndef _WIN32
+  if (batch_writer &&
+      entry.info.uncompressed_size <= greenworks::kBatchMaxFileSize) {
+    std::vector<char> data(entry.info.uncompressed_size);
+    size_t size = 0;
+    do {
+      err = unzReadCurrentFile(uf, data.data() + size,
+                               static_cast<unsigned>(data.size() - size));
+      if (err > 0)
+        size += err;
+    } while (err > 0 && size < data.size());
+    if (err >= 0)
+      err = size == data.size() ? UNZ_OK : UNZ_BADZIPFILE;
+    // Also checks the CRC, before anything is written.
     if (err == UNZ_OK)
       err = unzCloseCurrentFile(uf);
     else
-      unzCloseCurrentFile(uf); /* don't lose the error */
+      unzCloseCurrentFile(uf);
+    if (err == UNZ_OK) {
+      progress->AddBytesOut(size);
+      batch_writer->Write(write_filename, std::move(data),
+                          ToTime(entry.info.tmu_date));
+    }
+    return err;
+  }
+#endif
+
+  FILE* fout = fopen64(write_filename.c_str(), "wb");
+  if (fout == nullptr) {
+    unzCloseCurrentFile(uf);
+    return UNZ_ERRNO;
+  }
+
+  if (entry.info.uncompressed_size >= greenworks::kPipelineMinFileSize) {
+    // Large files are written on another thread while this one inflates
+    // the next buffer.
+    greenworks::PipelinedWriter writer(fout, entry.info.uncompressed_size);
+    std::vector<char> inflated(greenworks::kPipelineBufferSize);
+    do {
+      if (progress->IsCancelled()) {
+        err = greenworks::kArchiveCancelled;
+        break;
+      }
+      err = unzReadCurrentFile(uf, inflated.data(),
+                               static_cast<unsigned>(inflated.size()));
+      if (err > 0 && !writer.Write(inflated.data(), err))
+        err = UNZ_ERRNO;
+      if (err > 0)
+        progress->AddBytesOut(err);
+    } while (err > 0);
+    if (!writer.Finish() && err == UNZ_OK)
+      err = UNZ_ERRNO;
+  } else {
+    do {
+      if (progress->IsCancelled()) {
+        err = greenworks::kArchiveCancelled;
+        break;
+      }
+      err = unzReadCurrentFile(uf, buf, size_buf);
+      if (err < 0)
+        break;
+      if (err > 0 && fwrite(buf, err, 1, fout) != 1) {
+        err = UNZ_ERRNO;
+        break;
+      }
+      progress->AddBytesOut(err);
+    } while (err > 0);
   }
+  fclose(fout);
+  // Leave no half-written file behind.
+  if (err == greenworks::kArchiveCancelled)
+    remove(write_filename.c_str());
+
+  if (err == 0)
+    change_file_date(write_filename.c_str(), entry.info.dosDate,
+                     entry.info.tmu_date);
 
-  free(buf);
+  if (err == UNZ_OK)
+    err = unzCloseCurrentFile(uf);
+  else
+    unzCloseCurrentFile(uf); /* don't lose the error */
   return err;
 }
 
-int do_extract(unzFile uf, int opt_extract_without_path,
-    int opt_overwrite, const char* password) {
-  uLong i;
-  unz_global_info64 gi;
+// The MS-DOS date of |mtime| in local time, as extracted files are stamped
+// by change_file_date().
+uLong ToDosDate(time_t mtime) {
+  struct tm date;
+#ifdef _WIN32
+  localtime_s(&date, &mtime);
+#else
+  localtime_r(&mtime, &date);
+#endif
+  uLong year = date.tm_year + 1900;
+  year = year >= 1980 ? year - 1980 : 0;
+  return ((date.tm_mday + 32 * (date.tm_mon + 1) + 512 * year) << 16) |
+         (date.tm_sec / 2 + 32 * date.tm_min + 2048 * date.tm_hour);
+}
 
-  int err = unzGetGlobalInfo64(uf, &gi);
+// Whether |path| already holds the content of |entry|, judging by its size
+// and modification time, and with |check_crc| by its CRC.
+bool IsUnchangedOnDisk(const std::string& path, const ArchiveEntry& entry,
+                       bool check_crc, void* buf, uInt size_buf) {
+#ifdef _WIN32
+  struct _stat64 file_stat;
+  if (_stat64(path.c_str(), &file_stat) != 0)
+    return false;
+#else
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) != 0)
+    return false;
+#endif
+  if ((file_stat.st_mode & S_IFMT) != S_IFREG ||
+      static_cast<ZPOS64_T>(file_stat.st_size) !=
+          entry.info.uncompressed_size ||
+      ToDosDate(file_stat.st_mtime) != entry.info.dosDate) {
+    return false;
+  }
+  if (!check_crc)
+    return true;
+
+  FILE* fin = fopen64(path.c_str(), "rb");
+  if (fin == nullptr)
+    return false;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  size_t size_read;
+  while ((size_read = fread(buf, 1, size_buf, fin)) > 0)
+    crc = crc32(crc, static_cast<const Bytef*>(buf), size_read);
+  bool read_error = ferror(fin) != 0;
+  fclose(fin);
+  return !read_error && crc == entry.info.crc;
+}
+
+// Records which entries of an archive have been extracted, one index per
+// line after a header that identifies the archive. A journal written for a
+// different archive is started over.
+class ExtractJournal {
+ public:
+  ExtractJournal() : file_(nullptr) {}
+  ~ExtractJournal() {
+    if (file_)
+      fclose(file_);
+  }
+
+  // Reads the entries recorded in |path| so far and opens it for appending.
+  int Open(const std::string& path, const std::vector<ArchiveEntry>& entries);
+  bool IsDone(size_t index) const {
+    return index < done_.size() && done_[index];
+  }
+  // May be called from several threads at once.
+  int MarkDone(size_t index);
+  // Deletes the journal once the archive has been extracted completely.
+  void Remove();
+
+ private:
+  std::string path_;
+  FILE* file_;
+  // Only written by Open().
+  std::vector<bool> done_;
+  std::mutex mutex_;
+};
+
+int ExtractJournal::Open(const std::string& path,
+                         const std::vector<ArchiveEntry>& entries) {
+  uLong fingerprint = crc32(0L, Z_NULL, 0);
+  for (const ArchiveEntry& entry : entries) {
+    fingerprint = crc32(fingerprint,
+                        reinterpret_cast<const Bytef*>(entry.name.data()),
+                        static_cast<uInt>(entry.name.size()));
+    ZPOS64_T fields[] = {entry.info.crc, entry.info.compressed_size,
+                         entry.info.uncompressed_size, entry.offset};
+    fingerprint = crc32(fingerprint, reinterpret_cast<const Bytef*>(fields),
+                        sizeof(fields));
+  }
+  char header[64];
+  snprintf(header, sizeof(header), "greenworks-unzip %zu %08lx\n",
+           entries.size(), fingerprint);
+
+  path_ = path;
+  done_.assign(entries.size(), false);
+  bool resume = false;
+  char line[64];
+  if (FILE* fin = fopen64(path.c_str(), "rb")) {
+    resume = fgets(line, sizeof(line), fin) && strcmp(line, header) == 0;
+    // A line cut short by an interruption has no newline and is ignored.
+    while (resume && fgets(line, sizeof(line), fin)) {
+      char* end = nullptr;
+      unsigned long long index = strtoull(line, &end, 10);
+      if (*end == '\n' && end != line && index < done_.size())
+        done_[index] = true;
+    }
+    fclose(fin);
+  }
+
+  file_ = fopen64(path.c_str(), resume ? "ab" : "wb");
+  if (file_ == nullptr)
+    return UNZ_ERRNO;
+  if (!resume && (fputs(header, file_) < 0 || fflush(file_) != 0))
+    return UNZ_ERRNO;
+  return UNZ_OK;
+}
+
+int ExtractJournal::MarkDone(size_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fprintf(file_, "%zu\n", index) < 0 || fflush(file_) != 0)
+    return UNZ_ERRNO;
+  return UNZ_OK;
+}
+
+void ExtractJournal::Remove() {
+  fclose(file_);
+  file_ = nullptr;
+  remove(path_.c_str());
+}
+
+// The CRC of the compressed data of |entry|.
+int GetCompressedCrc(unzFile uf, const ArchiveEntry& entry, void* buf,
+                     uInt size_buf, uLong* crc) {
+  int err = unzSetOffset64(uf, entry.offset);
+  if (err != UNZ_OK)
+    return err;
+  err = unzOpenCurrentFile2(uf, nullptr, nullptr, 1);
   if (err != UNZ_OK)
     return err;
+  *crc = crc32(0L, Z_NULL, 0);
+  while ((err = unzReadCurrentFile(uf, buf, size_buf)) > 0)
+    *crc = crc32(*crc, static_cast<const Bytef*>(buf), err);
+  if (err == UNZ_OK)
+    err = unzCloseCurrentFile(uf);
+  else
+    unzCloseCurrentFile(uf); /* don't lose the error */
+  return err;
+}
+
+// Reflinks |path| to |source_path|, so they share their blocks until either
+// is written to.
+bool CloneFile(const std::string& source_path, const std::string& path) {
+#if defined(__linux__)
+  int source = open(source_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (source < 0)
+    return false;
+  int target = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0666);
+  bool cloned = target >= 0 && ioctl(target, FICLONE, source) == 0;
+  if (target >= 0)
+    close(target);
+  close(source);
+  return cloned;
+#elif defined(__APPLE__)
+  return clonefile(source_path.c_str(), path.c_str(), 0) == 0;
+#else
+  return false;
+#endif
+}
+
+bool CopyFileContents(const std::string& source_path, const std::string& path,
+                      void* buf, uInt size_buf) {
+  FILE* fin = fopen64(source_path.c_str(), "rb");
+  if (fin == nullptr)
+    return false;
+  FILE* fout = fopen64(path.c_str(), "wb");
+  if (fout == nullptr) {
+    fclose(fin);
+    return false;
+  }
+  bool ok = true;
+  size_t size_read;
+  while (ok && (size_read = fread(buf, 1, size_buf, fin)) > 0)
+    ok = fwrite(buf, size_read, 1, fout) == 1;
+  ok = ok && !ferror(fin);
+  fclose(fin);
+  return fclose(fout) == 0 && ok;
+}
+
+// Creates the file of |entry| from the already extracted file of |source|,
+// which has the same content.
+int CopyExtractedEntry(const ArchiveEntry& source, const ArchiveEntry& entry,
+                       const std::string& dirname, bool hardlink, void* buf,
+                       uInt size_buf) {
+  std::string source_path = JoinPath(dirname, source.name);
+  std::string path = JoinPath(dirname, entry.name);
+  // The file may be a hard link to |source_path| from an earlier run, which
+  // must not be written through.
+  remove(path.c_str());
+
+  // A hard link has only one date.
+  if (hardlink && entry.info.dosDate == source.info.dosDate) {
+#ifdef _WIN32
+    if (CreateHardLinkA(path.c_str(), source_path.c_str(), nullptr))
+      return UNZ_OK;
+#else
+    if (link(source_path.c_str(), path.c_str()) == 0)
+      return UNZ_OK;
+#endif
+  }
+  if (!CloneFile(source_path, path) &&
+      !CopyFileContents(source_path, path, buf, size_buf)) {
+    return UNZ_ERRNO;
+  }
+  change_file_date(path.c_str(), entry.info.dosDate, entry.info.tmu_date);
+  return UNZ_OK;
+}
+
+// Extracts one entry with the given handle and a scratch buffer.
+typedef std::function<int(unzFile uf, size_t index, void* buf, uInt size_buf)>
+    EntryExtractor;
+
+// Runs |extract| for entries [0, |entry_count|) on |threads| threads, each
+// with its own unzFile handle from |open_archive|. Threads pick the next
+// entry from a shared counter, so a few large entries don't leave the other
+// threads idle.
+int ExtractEntries(const std::function<unzFile()>& open_archive, unzFile uf,
+                   size_t entry_count, int threads,
+                   const EntryExtractor& extract) {
+  std::atomic<size_t> next_entry(0);
+  std::atomic<int> first_error(UNZ_OK);
+
+  auto extract_entries = [&](unzFile thread_uf) {
+    std::vector<char> buf(WRITEBUFFERSIZE);
+    while (first_error.load() == UNZ_OK) {
+      size_t i = next_entry++;
+      if (i >= entry_count)
+        return;
+      int err = extract(thread_uf, i, buf.data(), buf.size());
+      if (err != UNZ_OK) {
+        int expected = UNZ_OK;
+        first_error.compare_exchange_strong(expected, err);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<unzFile> handles;
+  for (int i = 1; i < threads && static_cast<size_t>(i) < entry_count; ++i) {
+    unzFile thread_uf = open_archive();
+    if (thread_uf == nullptr)
+      break;
+    handles.push_back(thread_uf);
+    workers.emplace_back(extract_entries, thread_uf);
+  }
+  // The calling thread extracts too, with the handle already opened.
+  extract_entries(uf);
+
+  for (std::thread& worker : workers)
+    worker.join();
+  for (unzFile handle : handles)
+    unzClose(handle);
+  return first_error.load();
+}
 
-  for (i = 0; i < gi.number_entry; i++) {
-    err = do_extract_currentfile(uf, &opt_extract_without_path, &opt_overwrite,
-        password);
+// Sets |sources|[i] to the index of the first entry with the same content as
+// entry i, which is i itself unless the entry is a duplicate. Entries are
+// taken to have the same content if their CRC and size match, and with
+// |verify| the CRC of their compressed data too.
+int FindDuplicateEntries(const std::function<unzFile()>& open_archive,
+                         unzFile uf, const std::vector<ArchiveEntry>& entries,
+                         bool verify, int threads,
+                         std::vector<size_t>* sources) {
+  typedef std::pair<uLong, ZPOS64_T> ContentKey;
+  std::map<ContentKey, size_t> content_counts;
+  for (const ArchiveEntry& entry : entries) {
+    if (!IsDirectoryEntry(entry) && entry.info.uncompressed_size > 0)
+      ++content_counts[ContentKey(entry.info.crc,
+                                  entry.info.uncompressed_size)];
+  }
+
+  // Only entries that have a match so far need their compressed data read.
+  std::vector<size_t> candidates;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const ArchiveEntry& entry = entries[i];
+    auto count = content_counts.find(
+        ContentKey(entry.info.crc, entry.info.uncompressed_size));
+    if (count != content_counts.end() && count->second > 1)
+      candidates.push_back(i);
+  }
+  std::vector<uLong> compressed_crcs(entries.size(), 0);
+  if (verify && !candidates.empty()) {
+    int err = ExtractEntries(
+        open_archive, uf, candidates.size(), threads,
+        [&](unzFile thread_uf, size_t i, void* buf, uInt size_buf) {
+          size_t index = candidates[i];
+          return GetCompressedCrc(thread_uf, entries[index], buf, size_buf,
+                                  &compressed_crcs[index]);
+        });
     if (err != UNZ_OK)
       return err;
+  }
 
-    if (i + 1 < gi.number_entry) {
-      err = unzGoToNextFile(uf);
-      if (err != UNZ_OK)
-        return err;
+  sources->resize(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    (*sources)[i] = i;
+  // CRC, size, compression method, compressed size and compressed CRC.
+  typedef std::tuple<uLong, ZPOS64_T, uLong, ZPOS64_T, uLong> DataKey;
+  std::map<DataKey, size_t> first_entries;
+  for (size_t i : candidates) {
+    const unz_file_info64& info = entries[i].info;
+    DataKey key(info.crc, info.uncompressed_size, 0, 0, 0);
+    if (verify) {
+      key = DataKey(info.crc, info.uncompressed_size,
+                    info.compression_method, info.compressed_size,
+                    compressed_crcs[i]);
     }
+    size_t first = first_entries.emplace(key, i).first->second;
+    // An archive may hold the same name twice.
+    if (entries[first].name != entries[i].name)
+      (*sources)[i] = first;
   }
+  return UNZ_OK;
+}
+
+// Inflates |entry| and throws the data away. Fails with UNZ_CRCERROR if it
+// doesn't match the CRC of the entry.
+int VerifyEntry(unzFile uf, const ArchiveEntry& entry, const char* password,
+                void* buf, uInt size_buf) {
+  int err = unzSetOffset64(uf, entry.offset);
+  if (err != UNZ_OK)
+    return err;
+  err = unzOpenCurrentFilePassword(uf, password);
+  if (err != UNZ_OK)
+    return err;
+  ZPOS64_T size = 0;
+  while ((err = unzReadCurrentFile(uf, buf, size_buf)) > 0)
+    size += err;
+  // unzCloseCurrentFile() only checks the CRC once everything was read.
+  if (err == UNZ_OK && size != entry.info.uncompressed_size)
+    err = UNZ_BADZIPFILE;
+  if (err == UNZ_OK)
+    err = unzCloseCurrentFile(uf);
+  else
+    unzCloseCurrentFile(uf); /* don't lose the error */
+  return err;
+}
+
+// Reads |entry| into |out|, which is allocated with malloc().
+int ExtractEntryToMemory(unzFile uf, const ArchiveEntry& entry,
+                         const char* password,
+                         greenworks::UnzipMemoryEntry* out) {
+  out->name = entry.name;
+  out->size = 0;
+  if (entry.info.uncompressed_size > SIZE_MAX - 1)
+    return UNZ_INTERNALERROR;
+  size_t size = static_cast<size_t>(entry.info.uncompressed_size);
+  out->data = static_cast<char*>(malloc(std::max<size_t>(size, 1)));
+  if (out->data == nullptr)
+    return UNZ_INTERNALERROR;
+
+  int err = unzSetOffset64(uf, entry.offset);
+  if (err != UNZ_OK)
+    return err;
+  err = unzOpenCurrentFilePassword(uf, password);
+  if (err != UNZ_OK)
+    return err;
+
+  do {
+    size_t remaining = size - out->size;
+    if (remaining == 0) {
+      // Anything left means the entry is larger than announced.
+      char extra;
+      err = unzReadCurrentFile(uf, &extra, 1);
+      if (err > 0)
+        err = UNZ_BADZIPFILE;
+      break;
+    }
+    err = unzReadCurrentFile(uf, out->data + out->size,
+                             static_cast<uInt>(
+                                 std::min<size_t>(remaining, 1 << 30)));
+    if (err > 0)
+      out->size += err;
+  } while (err > 0);
+  if (err == UNZ_OK && out->size != size)
+    err = UNZ_BADZIPFILE;
 
-  return 0;
+  if (err == UNZ_OK)
+    err = unzCloseCurrentFile(uf);
+  else
+    unzCloseCurrentFile(uf); /* don't lose the error */
+  return err;
 }
 
 }
@@ -266,50 +800,298 @@ int do_extract(unzFile uf, int opt_extract_without_path,
 namespace greenworks {
 
 int unzip(const char *zipfilename, const char *dirname, const char *password) {
-  char filename_try[MAXFILENAME + 16] = "";
-  unzFile uf = nullptr;
-  int ret_value = 0;
+  UnzipOptions options;
+  options.password = password;
+  return unzip(zipfilename, dirname, options);
+}
 
-  if (zipfilename != nullptr) {
-#ifdef USEWIN32IOAPI
-    zlib_filefunc64_def ffunc;
-#endif
+int unzip(const char *zipfilename, const char *dirname,
+          const UnzipOptions& options) {
+  if (zipfilename == nullptr || dirname == nullptr)
+    return 1;
 
-    strncpy(filename_try, zipfilename, MAXFILENAME - 1);
-    //strncpy doesnt append the trailing NULL, of the string is too long.
-    filename_try[MAXFILENAME] = '\0';
+  unzFile uf = OpenArchive(zipfilename);
+  if (uf == nullptr)
+    return 1;
 
-#ifdef USEWIN32IOAPI
-    fill_win32_filefunc64A(&ffunc);
-    uf = unzOpen2_64(zipfilename, &ffunc);
-#else
-    uf = unzOpen64(zipfilename);
-#endif
-    if (uf == nullptr) {
-      strcat(filename_try, ".zip");
-#ifdef USEWIN32IOAPI
-      uf = unzOpen2_64(filename_try, &ffunc);
-#else
-      uf = unzOpen64(filename_try);
+  std::vector<ArchiveEntry> entries;
+  int ret_value = ReadArchiveEntries(uf, &entries);
+  RemoveShadowedEntries(&entries);
+  if (ret_value == UNZ_OK)
+    ret_value = CreateDirectories(entries, dirname);
+  ArchiveProgress local_progress;
+  ArchiveProgress* progress =
+      options.progress ? options.progress : &local_progress;
+  for (const ArchiveEntry& entry : entries) {
+    if (!IsDirectoryEntry(entry))
+      progress->AddEntries(1, entry.info.uncompressed_size);
+  }
+  ExtractJournal journal;
+  bool use_journal = options.journal != nullptr && strlen(options.journal) > 0;
+  if (ret_value == UNZ_OK && use_journal)
+    ret_value = journal.Open(options.journal, entries);
+  auto open_archive = [zipfilename]() { return OpenArchive(zipfilename); };
+  int threads = GetThreadCount(options);
+  std::vector<size_t> sources;
+  if (ret_value == UNZ_OK && options.deduplicate) {
+    ret_value = FindDuplicateEntries(open_archive, uf, entries,
+                                     options.verify_duplicates, threads,
+                                     &sources);
+  }
+  // Entries are extracted first, then duplicates are made from them.
+  std::string dir(dirname);
+  std::unique_ptr<BatchFileWriter> batch_writer;
+#ifndef _WIN32
+  // With a single core, handing files to another thread only adds context
+  // switches.
+  bool batch_small_files =
+      std::thread::hardware_concurrency() > 1 &&
+      std::any_of(entries.begin(), entries.end(),
+                  [](const ArchiveEntry& entry) {
+                    return !IsDirectoryEntry(entry) &&
+                           entry.info.uncompressed_size <= kBatchMaxFileSize;
+                  });
+  if (batch_small_files)
+    batch_writer.reset(new BatchFileWriter(std::max(threads, 2)));
 #endif
-    }
+  for (bool duplicates : {false, true}) {
+    if (ret_value != UNZ_OK || (duplicates && sources.empty()))
+      break;
+    ret_value = ExtractEntries(
+        open_archive, uf, entries.size(), threads,
+        [&](unzFile thread_uf, size_t i, void* buf, uInt size_buf) {
+          const ArchiveEntry& entry = entries[i];
+          bool is_duplicate = !sources.empty() && sources[i] != i;
+          if (is_duplicate != duplicates || IsDirectoryEntry(entry))
+            return UNZ_OK;
+          if (progress->IsCancelled())
+            return kArchiveCancelled;
+          progress->StartEntry(entry.name);
+          if ((options.skip_unchanged || journal.IsDone(i)) &&
+              IsUnchangedOnDisk(JoinPath(dir, entry.name), entry,
+                                options.verify_crc, buf, size_buf)) {
+            progress->FinishEntry();
+            return UNZ_OK;
+          }
+          int err = UNZ_OK;
+          if (is_duplicate) {
+            err = CopyExtractedEntry(entries[sources[i]], entry, dir,
+                                     options.hardlink_duplicates, buf,
+                                     size_buf);
+            if (err == UNZ_OK)
+              progress->AddBytesOut(entry.info.uncompressed_size);
+          } else {
+            err = ExtractEntry(thread_uf, entry, dir, options.password,
+                               progress, batch_writer.get(), buf, size_buf);
+            if (err == UNZ_OK)
+              progress->AddBytesIn(entry.info.compressed_size);
+          }
+          if (err == UNZ_OK && use_journal)
+            err = journal.MarkDone(i);
+          if (err == UNZ_OK)
+            progress->FinishEntry();
+          return err;
+        });
+    // Duplicates are made from files that must be complete by then.
+    if (batch_writer && !batch_writer->Finish() && ret_value == UNZ_OK)
+      ret_value = UNZ_ERRNO;
   }
+  unzClose(uf);
+  if (ret_value != UNZ_OK && progress->IsCancelled())
+    ret_value = kArchiveCancelled;
+  if (ret_value == UNZ_OK && use_journal)
+    journal.Remove();
+
+  return ret_value;
+}
 
+int listArchive(const char* zipfilename, std::vector<ArchiveEntry>* entries) {
+  unzFile uf = OpenArchive(zipfilename);
   if (uf == nullptr)
-    return 1;
+    return UNZ_ERRNO;
+  int err = ReadArchiveEntries(uf, entries);
+  unzClose(uf);
+  return err;
+}
 
-#ifdef _WIN32
-  if (_chdir(dirname)) {
-#else
-  if (chdir(dirname)) {
-#endif
-    return 1;
+int verifyArchive(const char* zipfilename, const UnzipOptions& options,
+                  VerifyResult* result) {
+  auto start = std::chrono::steady_clock::now();
+  unzFile uf = OpenArchive(zipfilename);
+  if (uf == nullptr)
+    return UNZ_ERRNO;
+  std::vector<ArchiveEntry> entries;
+  int err = ReadArchiveEntries(uf, &entries);
+  // Set by the thread that checked the entry.
+  std::vector<char> corrupt(entries.size(), 0);
+  if (err == UNZ_OK) {
+    // Corrupt entries don't stop the others from being checked.
+    err = ExtractEntries(
+        [zipfilename]() { return OpenArchive(zipfilename); }, uf,
+        entries.size(), GetThreadCount(options),
+        [&](unzFile thread_uf, size_t i, void* buf, uInt size_buf) {
+          if (!IsDirectoryEntry(entries[i]) &&
+              VerifyEntry(thread_uf, entries[i], options.password, buf,
+                          size_buf) != UNZ_OK) {
+            corrupt[i] = 1;
+          }
+          return UNZ_OK;
+        });
   }
+  unzClose(uf);
+  if (err != UNZ_OK)
+    return err;
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (corrupt[i])
+      result->corrupt_entries.push_back(entries[i].name);
+    else if (!IsDirectoryEntry(entries[i]))
+      result->bytes += entries[i].info.uncompressed_size;
+  }
+  result->seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return UNZ_OK;
+}
+
+int unzipToMemory(const char* data, size_t size, const UnzipOptions& options,
+                  std::vector<UnzipMemoryEntry>* entries) {
+  MemoryFile file(data, size);
+  zlib_filefunc64_def ffunc;
+  file.FillFileFunc(&ffunc);
+  auto open_archive = [&ffunc]() {
+    return unzOpen2_64("memory.zip", &ffunc);
+  };
+  unzFile uf = open_archive();
+  if (uf == nullptr)
+    return UNZ_BADZIPFILE;
 
-  ret_value = do_extract(uf, 0, 1, password);
+  std::vector<ArchiveEntry> archive_entries;
+  int ret_value = ReadArchiveEntries(uf, &archive_entries);
+  // Directories have no content to hand back.
+  archive_entries.erase(
+      std::remove_if(archive_entries.begin(), archive_entries.end(),
+                     IsDirectoryEntry),
+      archive_entries.end());
+  entries->assign(archive_entries.size(), UnzipMemoryEntry());
+  if (ret_value == UNZ_OK) {
+    ret_value = ExtractEntries(
+        open_archive, uf, archive_entries.size(), GetThreadCount(options),
+        [&](unzFile thread_uf, size_t i, void* buf, uInt size_buf) {
+          return ExtractEntryToMemory(thread_uf, archive_entries[i],
+                                      options.password, &(*entries)[i]);
+        });
+  }
   unzClose(uf);
 
+  if (ret_value != UNZ_OK) {
+    for (UnzipMemoryEntry& entry : *entries)
+      free(entry.data);
+    entries->clear();
+  }
   return ret_value;
 }
 
+std::unique_ptr<ArchiveReader> ArchiveReader::Open(const char* zipfilename,
+                                                   const char* password,
+                                                   int* error) {
+  std::unique_ptr<ArchiveReader> reader(
+      new ArchiveReader(zipfilename, password ? password : ""));
+  unzFile uf = OpenArchive(zipfilename);
+  if (uf == nullptr) {
+    *error = UNZ_ERRNO;
+    return nullptr;
+  }
+  *error = ReadArchiveEntries(uf, &reader->entries_);
+  if (*error != UNZ_OK) {
+    unzClose(uf);
+    return nullptr;
+  }
+  reader->index_.reserve(reader->entries_.size());
+  for (size_t i = 0; i < reader->entries_.size(); ++i) {
+    // The first of several entries with the same name wins.
+    reader->index_.emplace(reader->entries_[i].name, i);
+  }
+  // The handle used for indexing is the first one ReadEntry() borrows.
+  reader->idle_handles_.push_back(uf);
+  return reader;
+}
+
+ArchiveReader::ArchiveReader(const std::string& path,
+                             const std::string& password)
+    : path_(path), password_(password) {}
+
+ArchiveReader::~ArchiveReader() {
+  for (unzFile uf : idle_handles_)
+    unzClose(uf);
+}
+
+const ArchiveEntry* ArchiveReader::Find(const std::string& name) const {
+  auto it = index_.find(name);
+  return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+int ArchiveReader::ReadEntry(const std::string& name,
+                             UnzipMemoryEntry* out) {
+  const ArchiveEntry* entry = Find(name);
+  if (entry == nullptr || IsDirectoryEntry(*entry))
+    return UNZ_END_OF_LIST_OF_FILE;
+  unzFile uf = AcquireHandle();
+  if (uf == nullptr)
+    return UNZ_ERRNO;
+  int err = ExtractEntryToMemory(
+      uf, *entry, password_.empty() ? nullptr : password_.c_str(), out);
+  ReleaseHandle(uf);
+  if (err != UNZ_OK) {
+    free(out->data);
+    out->data = nullptr;
+    out->size = 0;
+  }
+  return err;
+}
+
+int ArchiveReader::ReadRawEntry(
+    const ArchiveEntry& entry,
+    const std::function<bool(const char*, size_t)>& write) {
+  unzFile uf = AcquireHandle();
+  if (uf == nullptr)
+    return UNZ_ERRNO;
+  int err = unzSetOffset64(uf, entry.offset);
+  if (err == UNZ_OK)
+    err = unzOpenCurrentFile2(uf, nullptr, nullptr, 1);
+  if (err != UNZ_OK) {
+    ReleaseHandle(uf);
+    return err;
+  }
+
+  std::vector<char> buf(WRITEBUFFERSIZE);
+  do {
+    err = unzReadCurrentFile(uf, buf.data(), static_cast<uInt>(buf.size()));
+    if (err > 0 && !write(buf.data(), err))
+      err = UNZ_ERRNO;
+  } while (err > 0);
+
+  // Raw reads don't check the CRC, so closing only releases the entry.
+  unzCloseCurrentFile(uf);
+  ReleaseHandle(uf);
+  return err;
+}
+
+unzFile ArchiveReader::AcquireHandle() {
+  {
+    std::lock_guard<std::mutex> lock(handles_mutex_);
+    if (!idle_handles_.empty()) {
+      unzFile uf = idle_handles_.back();
+      idle_handles_.pop_back();
+      return uf;
+    }
+  }
+  // Opening only reads the end of the central directory, not the index.
+  return OpenArchive(path_.c_str());
+}
+
+void ArchiveReader::ReleaseHandle(unzFile uf) {
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  idle_handles_.push_back(uf);
+}
+
 }  // namespace greenworks
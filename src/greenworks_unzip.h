@@ -19,9 +19,149 @@
 #ifndef GREENWORKS_UNZIP_H_
 #define GREENWORKS_UNZIP_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "greenworks_archive_progress.h"
+#include "zlib/contrib/minizip/unzip.h"
+
 namespace greenworks {
 
+struct UnzipOptions {
+  UnzipOptions()
+      : password(nullptr),
+        threads(1),
+        skip_unchanged(false),
+        verify_crc(false),
+        journal(nullptr),
+        deduplicate(false),
+        hardlink_duplicates(false),
+        verify_duplicates(false),
+        progress(nullptr) {}
+
+  const char* password;
+  // Number of threads extracting entries in parallel, 0 for one per CPU core.
+  int threads;
+  // Leaves files alone whose size and modification time already match their
+  // entry, and with |verify_crc| their CRC as well.
+  bool skip_unchanged;
+  bool verify_crc;
+  // If set, every extracted entry is recorded in this file, so that running
+  // unzip() again after it was interrupted skips them (as long as they are
+  // unchanged on disk). It is deleted once everything has been extracted.
+  const char* journal;
+  // Inflates entries with the same CRC and size only once, and makes the
+  // other files reflinks (FICLONE, clonefile()) or copies of the first one.
+  // With |hardlink_duplicates| they are hard links instead when their dates
+  // match, so writing to one of them changes all of them.
+  bool deduplicate;
+  bool hardlink_duplicates;
+  // Only treats entries as duplicates if their compressed data has the same
+  // CRC as well, which never holds for encrypted entries.
+  bool verify_duplicates;
+  // Updated as files are extracted, if not null. Cancelling it makes unzip()
+  // remove the file it was writing and return kArchiveCancelled.
+  ArchiveProgress* progress;
+};
+
 int unzip(const char *zipfilename, const char *dirname, const char *password);
+int unzip(const char *zipfilename, const char *dirname,
+          const UnzipOptions& options);
+
+// A file read by unzipToMemory(). |data| is allocated with malloc() and
+// owned by the caller.
+struct UnzipMemoryEntry {
+  UnzipMemoryEntry() : data(nullptr), size(0) {}
+
+  std::string name;
+  char* data;
+  size_t size;
+};
+
+// Reads every file of the archive in |data| into memory. Directory entries
+// are skipped. On failure |entries| is left empty.
+int unzipToMemory(const char* data, size_t size, const UnzipOptions& options,
+                  std::vector<UnzipMemoryEntry>* entries);
+
+// An entry read from the central directory.
+struct ArchiveEntry {
+  std::string name;
+  // Offset of the entry in the central directory, for unzSetOffset64().
+  ZPOS64_T offset;
+  unz_file_info64 info;
+};
+
+// Reads the central directory of |zipfilename| without extracting anything.
+int listArchive(const char* zipfilename, std::vector<ArchiveEntry>* entries);
+
+struct VerifyResult {
+  VerifyResult() : bytes(0), seconds(0) {}
+
+  // Files that can't be inflated or whose CRC doesn't match the central
+  // directory, in archive order.
+  std::vector<std::string> corrupt_entries;
+  // Total size of the files checked, once inflated.
+  uint64_t bytes;
+  double seconds;
+};
+
+// Inflates every file of |zipfilename| without writing it anywhere, to check
+// it against its CRC. Uses |options.password| and |options.threads|. Returns
+// an error only if the archive can't be read at all; corrupt files are
+// listed in |result|.
+int verifyArchive(const char* zipfilename, const UnzipOptions& options,
+                  VerifyResult* result);
+
+// An archive whose central directory is read once and indexed by name, so
+// single files can be read without scanning or extracting the rest.
+class ArchiveReader {
+ public:
+  // Opens and indexes |zipfilename|. Returns null and sets |error| if it
+  // isn't a readable zip file. |password| is used for every ReadEntry().
+  static std::unique_ptr<ArchiveReader> Open(const char* zipfilename,
+                                             const char* password,
+                                             int* error);
+  ~ArchiveReader();
+
+  size_t entry_count() const { return entries_.size(); }
+  // Returns null if there is no entry called |name|.
+  const ArchiveEntry* Find(const std::string& name) const;
+
+  // Inflates the file called |name| into |out|. Returns
+  // UNZ_END_OF_LIST_OF_FILE if there is no such file. May be called from
+  // several threads at once: each call borrows its own unzFile handle.
+  int ReadEntry(const std::string& name, UnzipMemoryEntry* out);
+
+  // Passes the stored (still compressed) bytes of |entry| to |write| in
+  // chunks, without inflating or decrypting them. Returns UNZ_ERRNO as soon
+  // as |write| returns false.
+  int ReadRawEntry(const ArchiveEntry& entry,
+                   const std::function<bool(const char*, size_t)>& write);
+
+ private:
+  ArchiveReader(const std::string& path, const std::string& password);
+
+  unzFile AcquireHandle();
+  void ReleaseHandle(unzFile uf);
+
+  std::string path_;
+  std::string password_;
+  std::vector<ArchiveEntry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+
+  std::mutex handles_mutex_;
+  // Handles not used by a ReadEntry() call right now.
+  std::vector<unzFile> idle_handles_;
+
+  ArchiveReader(const ArchiveReader&) = delete;
+  ArchiveReader& operator=(const ArchiveReader&) = delete;
+};
 
 }  // namespace greenworks
 
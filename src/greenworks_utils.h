@@ -7,6 +7,7 @@
 
 #include <string>
 
+#include "nan.h"
 #include "steam/steamtypes.h"
 
 namespace utils {
@@ -27,6 +28,18 @@ std::string uint64ToString(uint64 value);
 
 uint64 strToUint64(std::string);
 
+// Creates a zero-filled typed array of |length| elements and returns a
+// pointer to its storage in |data|.
+template <typename ArrayType, typename T>
+v8::Local<ArrayType> NewTypedArray(size_t length, T** data) {
+  v8::Local<v8::ArrayBuffer> buffer =
+      v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(T));
+  v8::Local<ArrayType> array = ArrayType::New(buffer, 0, length);
+  Nan::TypedArrayContents<T> contents(array);
+  *data = *contents;
+  return array;
+}
+
 }  // namespace utils
 
 #endif  // SRC_GREENWORKS_UTILS_H_
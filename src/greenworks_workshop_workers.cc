@@ -97,15 +97,16 @@ FileShareWorker::FileShareWorker(Nan::Callback* success_callback,
 
 void FileShareWorker::Execute() {
   // Ignore empty path.
-  if (file_path_.empty()) return;
+  if (file_path_.empty()) {
+    SetCompleted();
+    return;
+  }
 
   std::string file_name = utils::GetFileNameFromPath(file_path_);
   SteamAPICall_t share_result = SteamRemoteStorage()->FileShare(
       file_name.c_str());
   call_result_.Set(share_result, this, &FileShareWorker::OnFileShareCompleted);
-
-  // Wait for FileShare callback result.
-  WaitForCompleted();
+  WatchCallResult(&call_result_, share_result);
 }
 
 void FileShareWorker::OnFileShareCompleted(
@@ -117,7 +118,7 @@ void FileShareWorker::OnFileShareCompleted(
   } else {
     SetErrorMessage("Error on sharing file on Steam cloud.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void FileShareWorker::HandleOKCallback() {
@@ -155,9 +156,7 @@ void PublishWorkshopFileWorker::Execute() {
 
   call_result_.Set(publish_result, this,
       &PublishWorkshopFileWorker::OnFilePublishCompleted);
-
-  // Wait for FileShare callback result.
-  WaitForCompleted();
+  WatchCallResult(&call_result_, publish_result);
 }
 
 void PublishWorkshopFileWorker::OnFilePublishCompleted(
@@ -169,7 +168,7 @@ void PublishWorkshopFileWorker::OnFilePublishCompleted(
   } else {
     SetErrorMessage("Error on publishing workshop file.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void PublishWorkshopFileWorker::HandleOKCallback() {
@@ -227,9 +226,7 @@ void UpdatePublishedWorkshopFileWorker::Execute() {
   update_published_file_call_result_.Set(commit_update_result, this,
       &UpdatePublishedWorkshopFileWorker::
            OnCommitPublishedFileUpdateCompleted);
-
-  // Wait for published workshop file updated.
-  WaitForCompleted();
+  WatchCallResult(&update_published_file_call_result_, commit_update_result);
 }
 
 void UpdatePublishedWorkshopFileWorker::OnCommitPublishedFileUpdateCompleted(
@@ -241,7 +238,7 @@ void UpdatePublishedWorkshopFileWorker::OnCommitPublishedFileUpdateCompleted(
   } else {
     SetErrorMessage("Error on getting published file details.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 QueryUGCWorker::QueryUGCWorker(Nan::Callback* success_callback,
@@ -280,7 +277,7 @@ void QueryUGCWorker::OnUGCQueryCompleted(SteamUGCQueryCompleted_t* result,
   } else {
     SetErrorMessage("Error on querying ugc.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 QueryAllUGCWorker::QueryAllUGCWorker(Nan::Callback* success_callback,
@@ -302,9 +299,7 @@ void QueryAllUGCWorker::Execute() {
   SteamAPICall_t ugc_query_result = SteamUGC()->SendQueryUGCRequest(ugc_handle);
   ugc_query_call_result_.Set(ugc_query_result, this,
       &QueryAllUGCWorker::OnUGCQueryCompleted);
-
-  // Wait for query all ugc completed.
-  WaitForCompleted();
+  WatchCallResult(&ugc_query_call_result_, ugc_query_result);
 }
 
 QueryUserUGCWorker::QueryUserUGCWorker(
@@ -328,9 +323,7 @@ void QueryUserUGCWorker::Execute() {
   SteamAPICall_t ugc_query_result = SteamUGC()->SendQueryUGCRequest(ugc_handle);
   ugc_query_call_result_.Set(ugc_query_result, this,
       &QueryUserUGCWorker::OnUGCQueryCompleted);
-
-  // Wait for query all ugc completed.
-  WaitForCompleted();
+  WatchCallResult(&ugc_query_call_result_, ugc_query_result);
 }
 
 DownloadItemWorker::DownloadItemWorker(Nan::Callback* success_callback,
@@ -346,9 +339,7 @@ void DownloadItemWorker::Execute() {
      SteamRemoteStorage()->UGCDownload(download_file_handle_, 0);
   call_result_.Set(download_item_result, this,
       &DownloadItemWorker::OnDownloadCompleted);
-
-  // Wait for downloading file completed.
-  WaitForCompleted();
+  WatchCallResult(&call_result_, download_item_result);
 }
 
 void DownloadItemWorker::OnDownloadCompleted(
@@ -372,7 +363,7 @@ void DownloadItemWorker::OnDownloadCompleted(
   } else {
     SetErrorMessage("Error on downloading file.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 SynchronizeItemsWorker::SynchronizeItemsWorker(Nan::Callback* success_callback,
@@ -397,9 +388,7 @@ void SynchronizeItemsWorker::Execute() {
   SteamAPICall_t ugc_query_result = SteamUGC()->SendQueryUGCRequest(ugc_handle);
   ugc_query_call_result_.Set(ugc_query_result, this,
       &SynchronizeItemsWorker::OnUGCQueryCompleted);
-
-  // Wait for synchronization completed.
-  WaitForCompleted();
+  WatchCallResult(&ugc_query_call_result_, ugc_query_result);
 }
 
 void SynchronizeItemsWorker::OnUGCQueryCompleted(
@@ -428,13 +417,14 @@ void SynchronizeItemsWorker::OnUGCQueryCompleted(
              download_ugc_items_handle_[current_download_items_pos_], 0);
       download_call_result_.Set(download_item_result, this,
           &SynchronizeItemsWorker::OnDownloadCompleted);
+      WatchCallResult(&download_call_result_, download_item_result);
       SteamUGC()->ReleaseQueryUGCRequest(result->m_handle);
       return;
     }
   } else {
     SetErrorMessage("Error on querying ugc.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void SynchronizeItemsWorker::OnDownloadCompleted(
@@ -457,7 +447,7 @@ void SynchronizeItemsWorker::OnDownloadCompleted(
 
     if (!is_save_success) {
       SetErrorMessage("Error on saving file on local machine.");
-      is_completed_ = true;
+      SetCompleted();
       return;
     }
 
@@ -466,7 +456,7 @@ void SynchronizeItemsWorker::OnDownloadCompleted(
     if (!utils::UpdateFileLastUpdatedTime(
             target_path.c_str(), static_cast<time_t>(file_updated_time))) {
       SetErrorMessage("Error on update file time on local machine.");
-      is_completed_ = true;
+      SetCompleted();
       return;
     }
     ++current_download_items_pos_;
@@ -475,12 +465,13 @@ void SynchronizeItemsWorker::OnDownloadCompleted(
           download_ugc_items_handle_[current_download_items_pos_], 0);
       download_call_result_.Set(download_item_result, this,
           &SynchronizeItemsWorker::OnDownloadCompleted);
+      WatchCallResult(&download_call_result_, download_item_result);
       return;
     }
   } else {
     SetErrorMessage("Error on downloading file.");
   }
-  is_completed_ = true;
+  SetCompleted();
 }
 
 void SynchronizeItemsWorker::HandleOKCallback() {
@@ -514,14 +505,12 @@ void UnsubscribePublishedFileWorker::Execute() {
       SteamRemoteStorage()->UnsubscribePublishedFile(unsubscribe_file_id_);
   unsubscribe_call_result_.Set(unsubscribed_result, this,
       &UnsubscribePublishedFileWorker::OnUnsubscribeCompleted);
-
-  // Wait for unsubscribing job completed.
-  WaitForCompleted();
+  WatchCallResult(&unsubscribe_call_result_, unsubscribed_result);
 }
 
 void UnsubscribePublishedFileWorker::OnUnsubscribeCompleted(
     RemoteStoragePublishedFileUnsubscribed_t* result, bool io_failure) {
-  is_completed_ = true;
+  SetCompleted();
 }
 
 }  // namespace greenworks
@@ -18,10 +18,24 @@
 
 #include "greenworks_zip.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <cstring>
 
+#include "greenworks_file_pipeline.h"
+#include "greenworks_memory_file.h"
+#include "greenworks_unzip.h"
 #include "zlib/zlib.h"
 #include "zlib/contrib/minizip/zip.h"
 
@@ -50,10 +64,12 @@
 #ifdef _WIN32
   #include <direct.h>
   #include <io.h>
+  #include <sys/stat.h>
   #include "misc/dirent.h"
 #else
   #include <dirent.h>
   #include <sys/types.h>
+  #include <sys/mman.h>
   #include <sys/stat.h>
   #include <unistd.h>
 #endif
@@ -63,213 +79,1311 @@
 #include "zlib/contrib/minizip/iowin32.h"
 #endif
 
-#define WRITEBUFFERSIZE (16384)
+#define WRITEBUFFERSIZE (64 * 1024)
 #define MAXFILENAME (256)
 
 namespace {
 
 #ifdef _WIN32
-/* char *f: name of file to get info on */
-/* tm_zip *tmzip: return value: access, modific. and creation times */
-/* uLong *dt: dostime */
-uLong filetime(const char *f, tm_zip *tmzip, uLong *dt)
+const char kPathSeparator[] = "\\\\";
+typedef struct _stat64 FileStat;
+#else
+const char kPathSeparator[] = "/";
+typedef struct stat FileStat;
+#endif
+
+// Fills the DOS date of |info| from a modification time.
+void SetFileTime(time_t mtime, zip_fileinfo* info) {
+  struct tm filedate;
+#ifdef _WIN32
+  localtime_s(&filedate, &mtime);
+#else
+  localtime_r(&mtime, &filedate);
+#endif
+  info->tmz_date.tm_sec = filedate.tm_sec;
+  info->tmz_date.tm_min = filedate.tm_min;
+  info->tmz_date.tm_hour = filedate.tm_hour;
+  info->tmz_date.tm_mday = filedate.tm_mday;
+  info->tmz_date.tm_mon = filedate.tm_mon;
+  info->tmz_date.tm_year = filedate.tm_year;
+  info->dosDate = 0;
+}
+
+/* calculate the CRC32 of a file, because to encrypt a file, we need known the CRC32 of the file before */
+int getFileCrc(FILE* fin, void* buf, unsigned long size_buf, unsigned long* result_crc)
 {
-  int ret = 0;
+  unsigned long calculate_crc = 0;
+  int err = ZIP_OK;
+  unsigned long size_read = 0;
+
+  do
   {
-    FILETIME ftLocal;
-    HANDLE hFind;
-    WIN32_FIND_DATAA ff32;
+    err = ZIP_OK;
+    size_read = (int)fread(buf, 1, size_buf, fin);
+    if (size_read < size_buf)
+      if (feof(fin) == 0)
+      {
+        err = ZIP_ERRNO;
+      }
 
-    hFind = FindFirstFileA(f, &ff32);
-    if (hFind != INVALID_HANDLE_VALUE)
-    {
-      FileTimeToLocalFileTime(&(ff32.ftLastWriteTime), &ftLocal);
-      FileTimeToDosDateTime(&ftLocal, ((LPWORD)dt) + 1, ((LPWORD)dt) + 0);
-      FindClose(hFind);
-      ret = 1;
-    }
+    if (size_read>0)
+      calculate_crc = crc32(calculate_crc, (const Bytef*)buf, size_read);
+
+  } while ((err == ZIP_OK) && (size_read>0));
+
+  // The caller compresses the file from the same handle afterwards.
+  rewind(fin);
+
+  *result_crc = calculate_crc;
+  return err;
+}
+
+// Files up to this size are read into memory when they can't be mapped.
+const ZPOS64_T kMaxBufferedFileSize = 64 * 1024 * 1024;
+// crc32() and zipWriteInFileInZip() take 32-bit lengths.
+const ZPOS64_T kDataChunkSize = 1 << 30;
+
+uLong DataCrc32(const char* data, ZPOS64_T size) {
+  uLong crc = 0;
+  for (ZPOS64_T offset = 0; offset < size; offset += kDataChunkSize) {
+    ZPOS64_T length = std::min(kDataChunkSize, size - offset);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data + offset),
+                static_cast<uInt>(length));
   }
-  return ret;
+  return crc;
 }
-#else
-uLong filetime(const char *f, tm_zip *tmzip, uLong *dt)
-{
-  int ret = 0;
-  struct stat s;        /* results of stat() */
-  struct tm* filedate;
-  time_t tm_t = 0;
 
-  if (strcmp(f, "-") != 0)
-  {
-    char name[MAXFILENAME + 1];
-    int len = strlen(f);
-    if (len > MAXFILENAME)
-      len = MAXFILENAME;
-
-    strncpy(name, f, MAXFILENAME - 1);
-    /* strncpy doesnt append the trailing NULL, of the string is too long. */
-    name[MAXFILENAME] = '\0';
-
-    if (name[len - 1] == '/')
-      name[len - 1] = '\0';
-    /* not all systems allow stat'ing a file with / appended */
-    if (stat(name, &s) == 0)
-    {
-      tm_t = s.st_mtime;
-      ret = 1;
+int WriteData(zipFile zf, const char* data, ZPOS64_T size) {
+  int err = ZIP_OK;
+  for (ZPOS64_T offset = 0; err == ZIP_OK && offset < size;
+       offset += kDataChunkSize) {
+    ZPOS64_T length = std::min(kDataChunkSize, size - offset);
+    err = zipWriteInFileInZip(zf, data + offset,
+                              static_cast<unsigned>(length));
+  }
+  return err;
+}
+
+// A read-only view of a whole file, so that its CRC and its compressed data
+// are computed from the same pages instead of reading the file twice.
+class FileView {
+ public:
+  FileView() : data_(nullptr), size_(0), mapped_(false) {}
+  ~FileView() {
+#ifndef _WIN32
+    if (mapped_)
+      munmap(const_cast<char*>(data_), static_cast<size_t>(size_));
+#endif
+  }
+
+  // Maps |file| into memory, or reads it if it can't be mapped and is small
+  // enough. Returns false if neither worked; |file| is left at its start.
+  bool Load(FILE* file, ZPOS64_T size) {
+    size_ = size;
+    if (size == 0)
+      return true;
+#ifndef _WIN32
+    if (size <= static_cast<ZPOS64_T>(SIZE_MAX)) {
+      void* mapping = mmap(nullptr, static_cast<size_t>(size), PROT_READ,
+                           MAP_PRIVATE, fileno(file), 0);
+      if (mapping != MAP_FAILED) {
+        madvise(mapping, static_cast<size_t>(size), MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapping);
+        mapped_ = true;
+        return true;
+      }
     }
+#endif
+    if (size > kMaxBufferedFileSize)
+      return false;
+    buffer_.resize(static_cast<size_t>(size));
+    if (fread(buffer_.data(), 1, buffer_.size(), file) != buffer_.size()) {
+      buffer_.clear();
+      rewind(file);
+      return false;
+    }
+    data_ = buffer_.data();
+    return true;
   }
-  filedate = localtime(&tm_t);
 
-  tmzip->tm_sec = filedate->tm_sec;
-  tmzip->tm_min = filedate->tm_min;
-  tmzip->tm_hour = filedate->tm_hour;
-  tmzip->tm_mday = filedate->tm_mday;
-  tmzip->tm_mon = filedate->tm_mon;
-  tmzip->tm_year = filedate->tm_year;
+  uLong Crc32() const { return DataCrc32(data_, size_); }
+
+  int WriteTo(zipFile zf) const { return WriteData(zf, data_, size_); }
+
+ private:
+  const char* data_;
+  ZPOS64_T size_;
+  bool mapped_;
+  std::vector<char> buffer_;
+};
+
+// A regular file found while walking the source directory.
+struct DirectoryEntry {
+  std::string path;
+  ZPOS64_T size;
+  time_t mtime;
+};
+
+// Called for every file found by WalkDirectory(). Returning anything but
+// ZIP_OK stops the walk.
+typedef std::function<int(const DirectoryEntry&)> FileVisitor;
 
-  return ret;
+struct OpenDirectory {
+  DIR* dir;
+  std::string path;
+};
+
+int SetWalkError(const std::string& path, std::string* error) {
+  if (error) {
+    *error = "Cannot read '" + path + "': " + strerror(errno);
+  }
+  return ZIP_ERRNO;
+}
+
+DIR* OpenChildDirectory(DIR* parent, const char* name,
+                        const std::string& path) {
+#ifdef _WIN32
+  return opendir(path.c_str());
+#else
+  int fd = openat(dirfd(parent), name,
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return nullptr;
+  DIR* dir = fdopendir(fd);
+  if (!dir)
+    close(fd);
+  return dir;
+#endif
 }
+
+int StatChild(DIR* parent, const char* name, const std::string& path,
+              bool follow_links, FileStat* file_stat) {
+#ifdef _WIN32
+  return _stat64(path.c_str(), file_stat);
+#else
+  return fstatat(dirfd(parent), name, file_stat,
+                 follow_links ? 0 : AT_SYMLINK_NOFOLLOW);
 #endif
+}
+
+// Calls |visit| for every regular file below |dir| as soon as it is found,
+// in readdir() order. Directories are walked with an explicit stack that
+// holds one open directory per level, and opened relative to their parent
+// where the platform allows it. d_type saves a stat() for directories; files
+// are stat'ed once for their size and modification time. Links to files are
+// followed, links to directories are skipped so that a cycle can't make the
+// walk loop forever.
+//
+// Returns ZIP_OK, ZIP_ERRNO with |error| set if a path couldn't be read, or
+// the first error returned by |visit|.
+int WalkDirectory(const std::string& dir, const FileVisitor& visit,
+                  std::string* error) {
+  std::vector<OpenDirectory> stack;
+  DIR* root = opendir(dir.c_str());
+  if (!root)
+    return SetWalkError(dir, error);
+  stack.push_back({root, dir});
 
-/* calculate the CRC32 of a file, because to encrypt a file, we need known the CRC32 of the file before */
-int getFileCrc(const char* filenameinzip, void* buf, unsigned long size_buf, unsigned long* result_crc)
-{
-  unsigned long calculate_crc = 0;
   int err = ZIP_OK;
-  FILE * fin = fopen(filenameinzip, "rb");
-  unsigned long size_read = 0;
-  unsigned long total_read = 0;
-  if (fin == nullptr)
-  {
-    err = ZIP_ERRNO;
+  while (err == ZIP_OK && !stack.empty()) {
+    DIR* parent = stack.back().dir;
+    errno = 0;
+    struct dirent* entry = readdir(parent);
+    if (!entry) {
+      if (errno != 0) {
+        err = SetWalkError(stack.back().path, error);
+        break;
+      }
+      closedir(parent);
+      stack.pop_back();
+      continue;
+    }
+
+    const char* name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+      continue;
+    std::string path = stack.back().path + kPathSeparator + name;
+
+    FileStat file_stat;
+    int type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      if (StatChild(parent, name, path, false, &file_stat) != 0) {
+        err = SetWalkError(path, error);
+        break;
+      }
+      type = S_ISDIR(file_stat.st_mode) ? DT_DIR : DT_REG;
+    }
+    if (type == DT_DIR) {
+      DIR* child = OpenChildDirectory(parent, name, path);
+      if (!child) {
+        err = SetWalkError(path, error);
+        break;
+      }
+      stack.push_back({child, path});
+      continue;
+    }
+
+    if (StatChild(parent, name, path, true, &file_stat) != 0) {
+      // Dangling links are skipped.
+      if (errno == ENOENT)
+        continue;
+      err = SetWalkError(path, error);
+      break;
+    }
+    // Links to directories, devices, FIFOs and sockets.
+    if (!S_ISREG(file_stat.st_mode))
+      continue;
+
+    DirectoryEntry file;
+    file.path = path;
+    file.size = static_cast<ZPOS64_T>(file_stat.st_size);
+    file.mtime = file_stat.st_mtime;
+    err = visit(file);
   }
 
-  if (err == ZIP_OK)
-    do
-    {
-      err = ZIP_OK;
-      size_read = (int)fread(buf, 1, size_buf, fin);
-      if (size_read < size_buf)
-        if (feof(fin) == 0)
-        {
-          err = ZIP_ERRNO;
-        }
+  for (OpenDirectory& open_dir : stack)
+    closedir(open_dir.dir);
+  return err;
+}
 
-      if (size_read>0)
-        calculate_crc = crc32(calculate_crc, (const Bytef*)buf, size_read);
-      total_read += size_read;
+// A file to be added to the archive.
+struct ZipEntry {
+  std::string path;
+  std::string name_in_zip;
+  ZPOS64_T size;
+  zip_fileinfo info;
+};
+
+ZipEntry MakeZipEntry(const std::string& source_dir,
+                      const DirectoryEntry& file) {
+  ZipEntry entry;
+  entry.path = file.path;
+  entry.size = file.size;
+
+  zip_fileinfo& zi = entry.info;
+  zi.internal_fa = 0;
+  zi.external_fa = 0;
+  SetFileTime(file.mtime, &zi);
+
+  // The path name saved, should not include a leading slash.
+  // if it did, windows/xp and dynazip couldn't read the zip file.
+#ifdef WIN32
+  std::string baseDir = file.path.substr(source_dir.rfind('\\') + 1);
+#else
+  std::string baseDir = file.path.substr(source_dir.rfind('/') + 1);
+#endif
+  size_t name_start = baseDir.find_first_not_of("\\/");
+  entry.name_in_zip =
+      name_start == std::string::npos ? "" : baseDir.substr(name_start);
+  return entry;
+}
 
-    } while ((err == ZIP_OK) && (size_read>0));
+using greenworks::ArchiveEntry;
+using greenworks::ArchiveProgress;
+using greenworks::ArchiveReader;
+using greenworks::MemoryFile;
+using greenworks::ZipEntryReport;
+using greenworks::ZipMemoryEntry;
+using greenworks::ZipOptions;
+using greenworks::ZipReport;
+using greenworks::kArchiveCancelled;
+
+// Extensions of formats that are compressed already.
+const char* const kCompressedExtensions[] = {
+    "7z", "apk", "avi", "bz2", "flac", "gif", "gz", "jar", "jpeg", "jpg",
+    "lz4", "m4a", "mkv", "mov", "mp3", "mp4", "ogg", "ogv", "opus", "png",
+    "rar", "webm", "webp", "woff", "woff2", "xz", "zip", "zst",
+};
+// How much of a file is deflated to guess whether it's compressible.
+const size_t kProbeSize = 16 * 1024;
+// Files smaller than this are always deflated; probing them costs more
+// than it could save.
+const ZPOS64_T kMinProbeFileSize = 4096;
+
+bool HasCompressedExtension(const std::string& path) {
+  size_t dot = path.find_last_of("./\\");
+  if (dot == std::string::npos || path[dot] != '.')
+    return false;
+  std::string extension = path.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  for (const char* compressed : kCompressedExtensions) {
+    if (extension == compressed)
+      return true;
+  }
+  return false;
+}
 
-    if (fin)
-      fclose(fin);
+// Whether deflating |entry| would burn CPU for next to no gain.
+bool IsIncompressible(const ZipEntry& entry) {
+  if (HasCompressedExtension(entry.path))
+    return true;
+  if (entry.size < kMinProbeFileSize)
+    return false;
 
-    *result_crc = calculate_crc;
-    return err;
+  // Errors are left for the actual read to report.
+  FILE* fin = fopen64(entry.path.c_str(), "rb");
+  if (fin == nullptr)
+    return false;
+  std::vector<Bytef> sample(kProbeSize);
+  size_t sample_size = fread(sample.data(), 1, sample.size(), fin);
+  fclose(fin);
+  if (sample_size == 0)
+    return false;
+
+  // The fastest level is a good enough estimate of the others.
+  uLongf probe_size = compressBound(static_cast<uLong>(sample_size));
+  std::vector<Bytef> probe(probe_size);
+  if (compress2(probe.data(), &probe_size, sample.data(),
+                static_cast<uLong>(sample_size), 1) != Z_OK) {
+    return false;
+  }
+  // Less than 3% smaller.
+  return probe_size * 100 >= sample_size * 97;
 }
 
-int isLargeFile(const char* filename) {
-  int largeFile = 0;
-  ZPOS64_T pos = 0;
-  FILE* pFile = fopen64(filename, "rb");
+// The level |entry| is compressed with.
+int GetEntryLevel(const ZipEntry& entry, const ZipOptions& options) {
+  if (options.store_incompressible && options.compression_level != 0 &&
+      IsIncompressible(entry)) {
+    return 0;
+  }
+  return options.compression_level;
+}
 
-  if (pFile != nullptr) {
-    fseeko64(pFile, 0, SEEK_END);
-    pos = ftello64(pFile);
+void AddToReport(ZipReport* report, const ZipEntry& entry, bool stored) {
+  if (report == nullptr)
+    return;
+  ZipEntryReport entry_report;
+  entry_report.name = entry.name_in_zip;
+  entry_report.size = entry.size;
+  entry_report.stored = stored;
+  report->entries.push_back(entry_report);
+  if (stored)
+    report->stored_bytes += entry.size;
+}
 
-    if (pos >= 0xffffffff)
-      largeFile = 1;
+// The MS-DOS date zipOpenNewFileInZip*() stores for |date|.
+uLong ToDosDate(const tm_zip& date) {
+  uLong year = date.tm_year;
+  if (year >= 1980)
+    year -= 1980;
+  else if (year >= 80)
+    year -= 80;
+  return ((date.tm_mday + 32 * (date.tm_mon + 1) + 512 * year) << 16) |
+         (date.tm_sec / 2 + 32 * date.tm_min + 2048 * date.tm_hour);
+}
+
+// The deflate level minizip recorded in the general purpose flag.
+int LevelFromFlag(uLong flag) {
+  switch ((flag >> 1) & 3) {
+    case 1:
+      return 9;
+    case 2:
+      return 2;
+    case 3:
+      return 1;
+    default:
+      return 6;
+  }
+}
 
-    fclose(pFile);
+// Returns the entry of |previous| that holds the same data as |entry|, or
+// null if it has to be compressed again. Size, date and compression method
+// are compared first; only then is the file read to compare the CRC.
+const ArchiveEntry* FindUnchangedEntry(ArchiveReader* previous,
+                                       const ZipEntry& entry, int level,
+                                       void* buf, int size_buf) {
+  if (previous == nullptr)
+    return nullptr;
+  const ArchiveEntry* old = previous->Find(entry.name_in_zip);
+  if (old == nullptr)
+    return nullptr;
+  const unz_file_info64& info = old->info;
+  if ((info.flag & 1) != 0 ||
+      info.compression_method != static_cast<uLong>(level ? Z_DEFLATED : 0) ||
+      info.uncompressed_size != entry.size ||
+      info.dosDate != ToDosDate(entry.info.tmz_date)) {
+    return nullptr;
   }
 
-  return largeFile;
+  FILE* fin = fopen64(entry.path.c_str(), "rb");
+  if (fin == nullptr)
+    return nullptr;
+  unsigned long crc = 0;
+  int err = getFileCrc(fin, buf, size_buf, &crc);
+  fclose(fin);
+  return err == ZIP_OK && crc == info.crc ? old : nullptr;
 }
 
-std::string PathCombine(std::string path1, std::string path2) {
-  char path[PATH_MAX];
+// Copies the stored bytes of |old| from |previous| into |zf| with minizip's
+// raw mode, so they are neither inflated nor deflated again.
+int CopyPreviousEntry(zipFile zf, const ZipEntry& entry,
+                      ArchiveReader* previous, const ArchiveEntry& old,
+                      ArchiveProgress* progress) {
+  const unz_file_info64& info = old.info;
+  int method = static_cast<int>(info.compression_method);
+  int level = method == Z_DEFLATED ? LevelFromFlag(info.flag) : 0;
+  int zip64 = info.uncompressed_size >= 0xffffffff ||
+              info.compressed_size >= 0xffffffff;
+  int err = zipOpenNewFileInZip4_64(zf, entry.name_in_zip.c_str(),
+      &entry.info, nullptr, 0, nullptr, 0, nullptr, method, level, 1,
+      -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, nullptr, 0, 36, 1 << 11,
+      zip64);
+  if (err != ZIP_OK)
+    return err;
 
-  strcpy(path, path1.c_str());
-#ifdef _WIN32
-  strcat(path, "\\\\");
-#else
-  strcat(path, "/");
-#endif
-  strcat(path, path2.c_str());
+  err = previous->ReadRawEntry(old, [&](const char* data, size_t size) {
+    progress->AddBytesIn(size);
+    return !progress->IsCancelled() &&
+           zipWriteInFileInZip(zf, data, static_cast<unsigned>(size)) ==
+               ZIP_OK;
+  });
+  if (err != UNZ_OK)
+    return progress->IsCancelled() ? kArchiveCancelled : ZIP_ERRNO;
+  return zipCloseFileInZipRaw64(zf, info.uncompressed_size, info.crc);
+}
 
-  //puts(path);
+// An entry deflated ahead of time by a worker thread. The writer copies it
+// into the archive as is, using minizip's raw mode.
+struct CompressedEntry {
+  CompressedEntry()
+      : ready(false),
+        err(ZIP_OK),
+        crc(0),
+        uncompressed_size(0),
+        compressed_size(0),
+        spool(nullptr),
+        previous(nullptr),
+        level(0) {}
+
+  bool ready;
+  int err;
+  uLong crc;
+  ZPOS64_T uncompressed_size;
+  ZPOS64_T compressed_size;
+  // The deflated data, unless it was spooled to a temporary file.
+  std::vector<char> data;
+  FILE* spool;
+  // Set instead of the above if the entry is copied from the previous
+  // archive.
+  const ArchiveEntry* previous;
+  // The level the entry was compressed with.
+  int level;
+};
+
+const size_t kCompressBufferSize = 256 * 1024;
+// Entries larger than this are deflated into a temporary file instead of
+// memory.
+const ZPOS64_T kMaxInMemoryEntrySize = 16 * 1024 * 1024;
+// How many entries the workers may run ahead of the writer.
+const size_t kEntriesPerThreadInFlight = 4;
+
+int AppendCompressedData(CompressedEntry* entry, const char* data,
+                         size_t size) {
+  if (size == 0)
+    return ZIP_OK;
+  entry->compressed_size += size;
+  if (entry->spool) {
+    if (fwrite(data, 1, size, entry->spool) != size)
+      return ZIP_ERRNO;
+    return ZIP_OK;
+  }
+  entry->data.insert(entry->data.end(), data, data + size);
+  return ZIP_OK;
+}
 
-  return path;
+// Files at least this large are split into blocks that are deflated on
+// several threads, like pigz does.
+const ZPOS64_T kMinBlockDeflateSize = 32 * 1024 * 1024;
+const size_t kDeflateBlockSize = 512 * 1024;
+// Each block is primed with the end of the one before, so matches may
+// reach back across the block boundary.
+const size_t kDeflateDictionarySize = 32 * 1024;
+
+// Entry workers that have run out of entries, lent to the block deflate of
+// large files. This keeps the number of threads deflating at once to the
+// number of workers.
+class ThreadBudget {
+ public:
+  explicit ThreadBudget(int threads) : threads_(threads), spare_(0) {}
+
+  int threads() const { return threads_; }
+  bool TryAcquire() {
+    int spare = spare_.load();
+    while (spare > 0) {
+      if (spare_.compare_exchange_weak(spare, spare - 1))
+        return true;
+    }
+    return false;
+  }
+  void Release(int count) { spare_ += count; }
+
+ private:
+  const int threads_;
+  std::atomic<int> spare_;
+};
+
+struct DeflateBlock {
+  DeflateBlock() : dictionary_size(0), last(false), done(false),
+                   err(ZIP_OK), crc(0) {}
+
+  // The end of the previous block followed by the block itself.
+  std::vector<char> input;
+  size_t dictionary_size;
+  bool last;
+  bool done;
+  int err;
+  uLong crc;
+  std::vector<char> output;
+};
+
+// Deflates |block| on its own. Every block but the last ends with a sync
+// flush, which pads it to a byte boundary, so the blocks can be joined into
+// one deflate stream.
+int DeflateBlockData(int level, DeflateBlock* block) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return ZIP_INTERNALERROR;
+  }
+  Bytef* input = reinterpret_cast<Bytef*>(block->input.data());
+  uInt size = static_cast<uInt>(block->input.size() - block->dictionary_size);
+  if (block->dictionary_size > 0 &&
+      deflateSetDictionary(&stream, input,
+                           static_cast<uInt>(block->dictionary_size)) !=
+          Z_OK) {
+    deflateEnd(&stream);
+    return ZIP_INTERNALERROR;
+  }
+  input += block->dictionary_size;
+  if (size > 0)
+    block->crc = crc32(0L, input, size);
+
+  int flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+  stream.next_in = input;
+  stream.avail_in = size;
+  // The flush marker isn't part of the bound.
+  block->output.resize(deflateBound(&stream, size) + 64);
+  size_t produced = 0;
+  int err = ZIP_OK;
+  while (true) {
+    stream.next_out = reinterpret_cast<Bytef*>(block->output.data()) +
+                      produced;
+    stream.avail_out = static_cast<uInt>(block->output.size() - produced);
+    int ret = deflate(&stream, flush);
+    produced = block->output.size() - stream.avail_out;
+    if (ret == Z_STREAM_ERROR) {
+      err = ZIP_INTERNALERROR;
+      break;
+    }
+    if (block->last ? ret == Z_STREAM_END
+                    : stream.avail_in == 0 && stream.avail_out > 0) {
+      break;
+    }
+    block->output.resize(block->output.size() * 2);
+  }
+  block->output.resize(produced);
+  deflateEnd(&stream);
+  return err;
 }
 
-std::vector<std::string> GetDirectoryList(const std::string& dir)
-{
-  DIR * d;
-  std::vector<std::string> ret;
+// Reads |fin| block by block on the calling thread and deflates the blocks,
+// appending them to |compressed| in order. The block CRCs are joined with
+// crc32_combine(). The calling thread deflates blocks itself when it can't
+// read ahead, and more threads are started as |budget| has spare ones.
+int DeflateBlocksInParallel(FILE* fin, int level, ThreadBudget* budget,
+                            ArchiveProgress* progress,
+                            CompressedEntry* compressed) {
+  // Blocks read but not appended yet, in file order. A deque, so workers
+  // can hold on to a block while more are added.
+  std::deque<DeflateBlock> blocks;
+  std::mutex mutex;
+  std::condition_variable block_read;
+  std::condition_variable block_done;
+  size_t first_block = 0;
+  size_t next_block = 0;
+  size_t read_blocks = 0;
+  bool reading_done = false;
+  bool aborted = false;
+  const size_t max_in_flight = 2 * budget->threads();
+
+  auto deflate_blocks = [&]() {
+    while (true) {
+      DeflateBlock* block;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        block_read.wait(lock, [&] {
+          return aborted || reading_done || next_block < read_blocks;
+        });
+        if (aborted || next_block >= read_blocks)
+          return;
+        block = &blocks[next_block++ - first_block];
+      }
+      int err = DeflateBlockData(level, block);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        block->err = err;
+        block->done = true;
+      }
+      block_done.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
 
-  /* Open the directory specified by "dir_name". */
-  d = opendir(dir.c_str());
+  int err = ZIP_OK;
+  std::vector<char> tail;
+  bool eof = false;
+  while (err == ZIP_OK) {
+    while (workers.size() + 1 < static_cast<size_t>(budget->threads()) &&
+           budget->TryAcquire()) {
+      workers.emplace_back(deflate_blocks);
+    }
+    bool can_read;
+    DeflateBlock* pending = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      can_read = !eof && blocks.size() < max_in_flight;
+      // Rather than wait, deflate the next block here.
+      if (!can_read && next_block < read_blocks &&
+          !blocks.front().done) {
+        pending = &blocks[next_block++ - first_block];
+      }
+    }
+    if (pending) {
+      int block_err = DeflateBlockData(level, pending);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending->err = block_err;
+        pending->done = true;
+      }
+      continue;
+    }
+    if (can_read) {
+      if (progress->IsCancelled()) {
+        err = kArchiveCancelled;
+        break;
+      }
+      DeflateBlock block;
+      block.dictionary_size = tail.size();
+      block.input.resize(tail.size() + kDeflateBlockSize);
+      std::copy(tail.begin(), tail.end(), block.input.begin());
+      size_t size_read = fread(block.input.data() + tail.size(), 1,
+                               kDeflateBlockSize, fin);
+      if (size_read < kDeflateBlockSize && ferror(fin)) {
+        err = ZIP_ERRNO;
+        break;
+      }
+      block.input.resize(tail.size() + size_read);
+      progress->AddBytesIn(size_read);
+      eof = size_read < kDeflateBlockSize;
+      block.last = eof;
+      size_t tail_size = std::min(block.input.size(), kDeflateDictionarySize);
+      tail.assign(block.input.end() - tail_size, block.input.end());
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(std::move(block));
+        ++read_blocks;
+        reading_done = eof;
+      }
+      block_read.notify_all();
+      continue;
+    }
 
-  /* Check it was opened. */
-  if (!d) {
-    // fprintf(stderr, "Cannot open directory '%s': %s\n", dir, strerror(errno));
-    exit(EXIT_FAILURE);
+    DeflateBlock* block;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      block_done.wait(lock, [&] {
+        return blocks.empty() || blocks.front().done;
+      });
+      if (blocks.empty())
+        break;
+      block = &blocks.front();
+    }
+    err = block->err;
+    if (err == ZIP_OK) {
+      ZPOS64_T size = block->input.size() - block->dictionary_size;
+      compressed->crc = crc32_combine(compressed->crc, block->crc,
+                                      static_cast<z_off_t>(size));
+      compressed->uncompressed_size += size;
+      err = AppendCompressedData(compressed, block->output.data(),
+                                 block->output.size());
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      blocks.pop_front();
+      ++first_block;
+    }
   }
 
-  while (1) {
-    struct dirent * entry;
-    const char * d_name;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+  }
+  block_read.notify_all();
+  for (std::thread& worker : workers)
+    worker.join();
+  budget->Release(static_cast<int>(workers.size()));
+  return err;
+}
 
-    /* "Readdir" gets subsequent entries from "d". */
-    entry = readdir(d);
+// Deflates |entry| into |compressed| as a raw deflate stream (or copies it
+// as is when |level| is 0), computing its CRC on the way. Very large files
+// are deflated in blocks, with spare threads from |budget|.
+int CompressEntry(const ZipEntry& entry, int level, ThreadBudget* budget,
+                  ArchiveProgress* progress, CompressedEntry* compressed) {
+  FILE* fin = fopen64(entry.path.c_str(), "rb");
+  if (fin == nullptr)
+    return ZIP_ERRNO;
 
-    if (!entry) {
-      /* There are no more entries in this directory, so break out of the while loop. */
+  if (entry.size > kMaxInMemoryEntrySize) {
+    compressed->spool = tmpfile();
+    // Don't fall back to memory for an entry this large.
+    if (compressed->spool == nullptr) {
+      fclose(fin);
+      return ZIP_ERRNO;
+    }
+  }
+
+  if (level != 0 && budget->threads() > 1 &&
+      entry.size >= kMinBlockDeflateSize) {
+    int err = DeflateBlocksInParallel(fin, level, budget, progress,
+                                      compressed);
+    fclose(fin);
+    return err;
+  }
+
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  bool deflating = level != 0;
+  if (deflating &&
+      deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    fclose(fin);
+    return ZIP_INTERNALERROR;
+  }
+
+  // Large files are read on another thread while this one deflates.
+  std::unique_ptr<greenworks::PipelinedReader> reader;
+  if (entry.size >= greenworks::kPipelineMinFileSize)
+    reader.reset(new greenworks::PipelinedReader(fin));
+  std::vector<char> in(reader ? 0 : kCompressBufferSize);
+  std::vector<char> out(kCompressBufferSize);
+  int err = ZIP_OK;
+  int flush = Z_NO_FLUSH;
+  do {
+    if (progress->IsCancelled()) {
+      err = kArchiveCancelled;
       break;
     }
+    const char* data = in.data();
+    size_t size_read;
+    if (reader) {
+      if (!reader->Next(&data, &size_read)) {
+        err = ZIP_ERRNO;
+        break;
+      }
+      flush = size_read == 0 ? Z_FINISH : Z_NO_FLUSH;
+    } else {
+      size_read = fread(in.data(), 1, in.size(), fin);
+      if (size_read < in.size() && ferror(fin)) {
+        err = ZIP_ERRNO;
+        break;
+      }
+      flush = feof(fin) ? Z_FINISH : Z_NO_FLUSH;
+    }
+    // crc32() resets the CRC for a null buffer, which the reader returns at
+    // the end of the file.
+    if (size_read > 0) {
+      compressed->crc = crc32(compressed->crc,
+                              reinterpret_cast<const Bytef*>(data),
+                              static_cast<uInt>(size_read));
+    }
+    compressed->uncompressed_size += size_read;
+    progress->AddBytesIn(size_read);
 
-    d_name = entry->d_name;
+    if (!deflating) {
+      err = AppendCompressedData(compressed, data, size_read);
+      continue;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size_read);
+    do {
+      stream.next_out = reinterpret_cast<Bytef*>(out.data());
+      stream.avail_out = static_cast<uInt>(out.size());
+      if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+        err = ZIP_INTERNALERROR;
+        break;
+      }
+      err = AppendCompressedData(compressed, out.data(),
+                                 out.size() - stream.avail_out);
+    } while (err == ZIP_OK && stream.avail_out == 0);
+  } while (err == ZIP_OK && flush != Z_FINISH);
+
+  if (deflating)
+    deflateEnd(&stream);
+  reader.reset();
+  fclose(fin);
+  return err;
+}
 
-    /* See if "entry" is a subdirectory of "d". */
-    if (entry->d_type & DT_DIR) {
+int WriteCompressedEntry(zipFile zf, const ZipEntry& entry,
+                         const CompressedEntry& compressed, int level,
+                         const char* password, void* buf, int size_buf) {
+  int zip64 = compressed.uncompressed_size >= 0xffffffff ||
+              compressed.compressed_size >= 0xffffffff;
+  int err = zipOpenNewFileInZip4_64(zf, entry.name_in_zip.c_str(),
+      &entry.info, nullptr, 0, nullptr, 0, nullptr,
+      (level != 0) ? Z_DEFLATED : 0, level, 1, -MAX_WBITS, DEF_MEM_LEVEL,
+      Z_DEFAULT_STRATEGY, password, compressed.crc, 36, 1 << 11, zip64);
+  if (err != ZIP_OK)
+    return err;
 
-      /* Check that the directory is not "d" or d's parent. */
-      if (strcmp(d_name, "..") != 0 && strcmp(d_name, ".") != 0) {
-        int path_length;
-        char path[PATH_MAX];
+  if (compressed.spool) {
+    rewind(compressed.spool);
+    size_t size_read = 0;
+    while (err == ZIP_OK &&
+           (size_read = fread(buf, 1, size_buf, compressed.spool)) > 0) {
+      err = zipWriteInFileInZip(zf, buf, static_cast<unsigned>(size_read));
+    }
+    if (err == ZIP_OK && ferror(compressed.spool))
+      err = ZIP_ERRNO;
+  } else {
+    // zipWriteInFileInZip() takes an unsigned size.
+    const char* data = compressed.data.data();
+    size_t left = compressed.data.size();
+    while (err == ZIP_OK && left > 0) {
+      unsigned size = static_cast<unsigned>(
+          std::min<size_t>(left, std::numeric_limits<unsigned>::max()));
+      err = zipWriteInFileInZip(zf, data, size);
+      data += size;
+      left -= size;
+    }
+  }
 
-        strcpy(path, dir.c_str());
-#ifdef WIN32
-        strcat(path, "\\\\");
-#else
-        strcat(path, "/");
-#endif
-        strcat(path, d_name);
+  if (err < 0)
+    return ZIP_ERRNO;
+  return zipCloseFileInZipRaw64(zf, compressed.uncompressed_size,
+                                compressed.crc);
+}
+
+// Writes one file to |zf|, compressing it on the calling thread unless it
+// can be copied from |previous|.
+int WriteEntry(zipFile zf, const ZipEntry& entry, int level,
+               const char* password, ArchiveReader* previous,
+               ArchiveProgress* progress, void* buf, int size_buf) {
+  const ArchiveEntry* old =
+      FindUnchangedEntry(previous, entry, level, buf, size_buf);
+  if (old != nullptr)
+    return CopyPreviousEntry(zf, entry, previous, *old, progress);
+
+  const char* filenameinzip = entry.path.c_str();
+  const char *savefilenameinzip = entry.name_in_zip.c_str();
+  int err = ZIP_OK;
+
+  FILE* fin = fopen64(filenameinzip, "rb");
+  if (fin == nullptr)
+    return ZIP_ERRNO;
+  // Sized by the walk; the file isn't stat'ed again.
+  ZPOS64_T file_size = entry.size;
+  int zip64 = file_size >= 0xffffffff;
+
+  // Encryption needs the CRC before any data is written, so the file is
+  // loaded once and both the CRC and the deflate run over that view.
+  // Files that can't be loaded are read twice through the same handle.
+  FileView view;
+  bool use_view = false;
+  unsigned long crcFile = 0;
+  if (password != nullptr && strlen(password) > 0) {
+    use_view = view.Load(fin, file_size);
+    if (use_view)
+      crcFile = view.Crc32();
+    else
+      err = getFileCrc(fin, buf, size_buf, &crcFile);
+  }
+
+  // Using 4 for unicode compatibility (UTF8) -- tested with chinese, does not work as expected
+  if (err == ZIP_OK)
+    err = zipOpenNewFileInZip4_64(zf, savefilenameinzip, &entry.info, nullptr, 0, nullptr, 0, nullptr, (level != 0) ? Z_DEFLATED : 0, level, 0, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password, crcFile, 36, 1 << 11, zip64);
 
-        //puts(path);
+  if (err != ZIP_OK) {
+    fclose(fin);
+    return err;
+  }
+
+  if (use_view) {
+    err = view.WriteTo(zf);
+    progress->AddBytesIn(file_size);
+  } else if (file_size >= greenworks::kPipelineMinFileSize) {
+    // The next chunk is read while minizip deflates this one.
+    greenworks::PipelinedReader reader(fin);
+    const char* data;
+    size_t size;
+    bool read_ok = true;
+    while (err == ZIP_OK && (read_ok = reader.Next(&data, &size)) && size > 0) {
+      progress->AddBytesIn(size);
+      err = progress->IsCancelled()
+                ? kArchiveCancelled
+                : zipWriteInFileInZip(zf, data, static_cast<unsigned>(size));
+    }
+    if (err == ZIP_OK && !read_ok)
+      err = ZIP_ERRNO;
+  } else {
+    int size_read;
+    do {
+      err = ZIP_OK;
+      size_read = (int)fread(buf, 1, size_buf, fin);
+      if (size_read < size_buf)
+        if (feof(fin) == 0)
+          err = ZIP_ERRNO;
 
-        path_length = strlen(path);
+      if (size_read>0) {
+        progress->AddBytesIn(size_read);
+        err = zipWriteInFileInZip(zf, buf, size_read);
+      }
+      if (err == ZIP_OK && progress->IsCancelled())
+        err = kArchiveCancelled;
+    } while ((err == ZIP_OK) && (size_read>0));
+  }
+  fclose(fin);
+  if (err == kArchiveCancelled)
+    return err;
+  if (err < 0)
+    return ZIP_ERRNO;
+  return zipCloseFileInZip(zf);
+}
 
-        if (path_length >= PATH_MAX) {
-          fprintf(stderr, "Path length has got too long.\n");
-          exit(EXIT_FAILURE);
-        }
-        std::vector<std::string> rret = GetDirectoryList(path);
-        ret.insert(ret.end(), rret.begin(), rret.end());
+// Walks |source_dir| on a separate thread and deflates the files on
+// |threads| worker threads as soon as they are found, while the calling
+// thread writes them to |zf| in the order they were found.
+int WriteEntriesInParallel(zipFile zf, const std::string& source_dir,
+                           const ZipOptions& options, ArchiveReader* previous,
+                           int threads, void* buf, int size_buf,
+                           size_t* entry_count, std::string* error) {
+  // Deques, so that workers can use an entry without holding the lock while
+  // the walker appends more.
+  std::deque<ZipEntry> entries;
+  std::deque<CompressedEntry> compressed;
+  std::mutex mutex;
+  // Signalled when an entry is found or written, either of which may let a
+  // worker take the next entry.
+  std::condition_variable entry_available;
+  std::condition_variable entry_ready;
+  bool walk_done = false;
+  int walk_err = ZIP_OK;
+  size_t next_entry = 0;
+  size_t written_entries = 0;
+  bool aborted = false;
+  const size_t max_in_flight = threads * kEntriesPerThreadInFlight;
+  ThreadBudget budget(threads);
+
+  std::thread walker([&]() {
+    int result = WalkDirectory(source_dir, [&](const DirectoryEntry& file) {
+      if (options.progress->IsCancelled())
+        return kArchiveCancelled;
+      ZipEntry entry = MakeZipEntry(source_dir, file);
+      options.progress->AddEntries(1, entry.size);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (aborted)
+          return ZIP_INTERNALERROR;
+        entries.push_back(std::move(entry));
+        compressed.emplace_back();
       }
+      entry_available.notify_all();
+      return ZIP_OK;
+    }, error);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      walk_done = true;
+      walk_err = result;
     }
-    else {
-      ret.push_back(PathCombine(dir, entry->d_name));
+    entry_available.notify_all();
+    entry_ready.notify_all();
+  });
+
+  auto compress_entries = [&]() {
+    std::vector<char> crc_buf(WRITEBUFFERSIZE);
+    while (true) {
+      size_t i;
+      const ZipEntry* entry;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Both conditions in one wait, so that they hold together once the
+        // lock is taken back.
+        entry_available.wait(lock, [&] {
+          return aborted ||
+                 (next_entry < written_entries + max_in_flight &&
+                  (walk_done || next_entry < entries.size()));
+        });
+        if (aborted || next_entry >= entries.size())
+          return;
+        i = next_entry++;
+        entry = &entries[i];
+      }
+      CompressedEntry result;
+      result.level = GetEntryLevel(*entry, options);
+      result.previous = FindUnchangedEntry(previous, *entry, result.level,
+                                           crc_buf.data(),
+                                           static_cast<int>(crc_buf.size()));
+      if (result.previous == nullptr) {
+        result.err = CompressEntry(*entry, result.level, &budget,
+                                   options.progress, &result);
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.ready = true;
+        compressed[i] = std::move(result);
+      }
+      entry_ready.notify_all();
     }
+  };
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back([&]() {
+      compress_entries();
+      // Its thread may deflate blocks of the remaining large files now.
+      budget.Release(1);
+    });
+  }
+
+  int err = ZIP_OK;
+  for (size_t i = 0; err == ZIP_OK; ++i) {
+    CompressedEntry entry;
+    const ZipEntry* zip_entry;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      entry_ready.wait(lock, [&] {
+        return (i < compressed.size() && compressed[i].ready) ||
+               (walk_done && (walk_err != ZIP_OK || i >= entries.size()));
+      });
+      if (walk_done && (walk_err != ZIP_OK || i >= entries.size())) {
+        err = walk_err;
+        break;
+      }
+      entry = std::move(compressed[i]);
+      compressed[i] = CompressedEntry();
+      zip_entry = &entries[i];
+    }
+    err = entry.err;
+    if (err == ZIP_OK)
+      options.progress->StartEntry(zip_entry->name_in_zip);
+    if (err == ZIP_OK && entry.previous) {
+      err = CopyPreviousEntry(zf, *zip_entry, previous, *entry.previous,
+                              options.progress);
+    } else if (err == ZIP_OK) {
+      err = WriteCompressedEntry(zf, *zip_entry, entry, entry.level,
+                                 options.password, buf, size_buf);
+    }
+    if (err == ZIP_OK) {
+      AddToReport(options.report, *zip_entry,
+                  entry.level != options.compression_level);
+      options.progress->FinishEntry();
+    }
+    if (entry.spool)
+      fclose(entry.spool);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++written_entries;
+      *entry_count = written_entries;
+      if (err != ZIP_OK)
+        aborted = true;
+    }
+    entry_available.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+  }
+  entry_available.notify_all();
+  walker.join();
+  for (std::thread& worker : workers)
+    worker.join();
+  // Entries compressed after an error was hit are never written.
+  for (CompressedEntry& entry : compressed) {
+    if (entry.spool)
+      fclose(entry.spool);
+  }
+  return err;
+}
+
+// Adds every file below |source_dir| to |zf|. Files that haven't changed
+// since |previous| (if not null) was written are copied from there.
+int ZipDirectory(zipFile zf, const char* source_dir,
+                 const ZipOptions& zip_options, ArchiveReader* previous,
+                 std::string* error_message) {
+  ArchiveProgress local_progress;
+  ZipOptions options = zip_options;
+  if (options.progress == nullptr)
+    options.progress = &local_progress;
+  int size_buf = WRITEBUFFERSIZE;
+  void* buf = malloc(size_buf);
+  if (buf == nullptr)
+    return ZIP_INTERNALERROR;
+
+  int threads = options.threads;
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Files are compressed as they are found rather than after the whole tree
+  // has been listed.
+  int err = ZIP_OK;
+  size_t entry_count = 0;
+  if (threads > 1) {
+    err = WriteEntriesInParallel(zf, source_dir, options, previous, threads,
+                                 buf, size_buf, &entry_count, error_message);
+  } else {
+    err = WalkDirectory(source_dir, [&](const DirectoryEntry& file) {
+      if (options.progress->IsCancelled())
+        return kArchiveCancelled;
+      ++entry_count;
+      ZipEntry entry = MakeZipEntry(source_dir, file);
+      options.progress->AddEntries(1, entry.size);
+      options.progress->StartEntry(entry.name_in_zip);
+      int level = GetEntryLevel(entry, options);
+      int result = WriteEntry(zf, entry, level, options.password, previous,
+                              options.progress, buf, size_buf);
+      if (result == ZIP_OK) {
+        AddToReport(options.report, entry, level != options.compression_level);
+        options.progress->FinishEntry();
+      }
+      return result;
+    }, error_message);
   }
-  /* After going through all the entries, close the directory. */
-  if (closedir(d)) {
-    // fprintf(stderr, "Could not close '%s': %s\n", dir, strerror(errno));
-    exit(EXIT_FAILURE);
+  if (err == ZIP_OK && entry_count == 0)
+    err = ZIP_PARAMERROR;
+  if (err != ZIP_OK && options.progress->IsCancelled())
+    err = kArchiveCancelled;
+  free(buf);
+  return err;
+}
+
+int WriteMemoryEntry(zipFile zf, const ZipMemoryEntry& entry, time_t mtime,
+                     const ZipOptions& options) {
+  zip_fileinfo info;
+  info.internal_fa = 0;
+  info.external_fa = 0;
+  SetFileTime(mtime, &info);
+
+  // Same as for files: no leading slash.
+  size_t name_start = entry.name.find_first_not_of("\\/");
+  std::string name =
+      name_start == std::string::npos ? "" : entry.name.substr(name_start);
+  const char* password = options.password;
+  int level = options.compression_level;
+  uLong crc = 0;
+  if (password != nullptr && strlen(password) > 0)
+    crc = DataCrc32(entry.data, entry.size);
+
+  int err = zipOpenNewFileInZip4_64(zf, name.c_str(), &info, nullptr, 0,
+      nullptr, 0, nullptr, (level != 0) ? Z_DEFLATED : 0, level, 0,
+      -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password, crc, 36,
+      1 << 11, entry.size >= 0xffffffff);
+  if (err != ZIP_OK)
+    return err;
+  err = WriteData(zf, entry.data, entry.size);
+  if (err < 0)
+    return ZIP_ERRNO;
+  return zipCloseFileInZip(zf);
+}
+
+// Opens an archive that is written to |file| instead of the disk.
+zipFile OpenMemoryArchive(MemoryFile* file) {
+  zlib_filefunc64_def ffunc;
+  file->FillFileFunc(&ffunc);
+  return zipOpen2_64("memory.zip", APPEND_STATUS_CREATE, nullptr, &ffunc);
+}
+
+// Closes |zf| and hands the archive written to |file| over to the caller.
+int CloseMemoryArchive(zipFile zf, MemoryFile* file, int err, char** data,
+                       size_t* size) {
+  int close_err = zipClose(zf, nullptr);
+  if (err == ZIP_OK)
+    err = close_err;
+  if (err != ZIP_OK)
+    return err;
+  *data = file->Release(size);
+  return *data ? ZIP_OK : ZIP_INTERNALERROR;
+}
+
+// Opens |options.previous_archive| for reuse. Returns null if there is none
+// or it can't be read, in which case every file is compressed. Nothing is
+// reused for password-protected archives, since the old entries would have
+// to be re-encrypted anyway.
+std::unique_ptr<ArchiveReader> OpenPreviousArchive(const ZipOptions& options) {
+  if (options.previous_archive == nullptr ||
+      strlen(options.previous_archive) == 0 ||
+      (options.password != nullptr && strlen(options.password) > 0)) {
+    return nullptr;
   }
+  int err = UNZ_OK;
+  return ArchiveReader::Open(options.previous_archive, nullptr, &err);
+}
 
-  return ret;
+// File functions that forward to |base| and count the bytes written to the
+// archive in |progress|.
+struct CountingFileFunc {
+  zlib_filefunc64_def base;
+  ArchiveProgress* progress;
+
+  static voidpf ZCALLBACK Open(voidpf opaque, const void* filename,
+                               int mode) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.zopen64_file(self->base.opaque, filename, mode);
+  }
+  static uLong ZCALLBACK Read(voidpf opaque, voidpf stream, void* buf,
+                              uLong size) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.zread_file(self->base.opaque, stream, buf, size);
+  }
+  static uLong ZCALLBACK Write(voidpf opaque, voidpf stream, const void* buf,
+                               uLong size) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    uLong written = self->base.zwrite_file(self->base.opaque, stream, buf,
+                                           size);
+    self->progress->AddBytesOut(written);
+    return written;
+  }
+  static ZPOS64_T ZCALLBACK Tell(voidpf opaque, voidpf stream) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.ztell64_file(self->base.opaque, stream);
+  }
+  static long ZCALLBACK Seek(voidpf opaque, voidpf stream,  // NOLINT
+                             ZPOS64_T offset, int origin) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.zseek64_file(self->base.opaque, stream, offset, origin);
+  }
+  static int ZCALLBACK Close(voidpf opaque, voidpf stream) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.zclose_file(self->base.opaque, stream);
+  }
+  static int ZCALLBACK TestError(voidpf opaque, voidpf stream) {
+    auto* self = static_cast<CountingFileFunc*>(opaque);
+    return self->base.zerror_file(self->base.opaque, stream);
+  }
+
+  void Fill(zlib_filefunc64_def* ffunc) {
+    ffunc->zopen64_file = &Open;
+    ffunc->zread_file = &Read;
+    ffunc->zwrite_file = &Write;
+    ffunc->ztell64_file = &Tell;
+    ffunc->zseek64_file = &Seek;
+    ffunc->zclose_file = &Close;
+    ffunc->zerror_file = &TestError;
+    ffunc->opaque = this;
+  }
+};
+
+// Moves the finished archive at |from| over |to|.
+int ReplaceArchive(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+  // rename() doesn't overwrite existing files on Windows.
+  remove(to.c_str());
+#endif
+  return rename(from.c_str(), to.c_str()) == 0 ? ZIP_OK : ZIP_ERRNO;
 }
 
 }
@@ -277,21 +1391,19 @@ std::vector<std::string> GetDirectoryList(const std::string& dir)
 namespace greenworks {
 
 int zip(const char* targetFile, const char* sourceDir, int compressionLevel, const char* password) {
-  // compressionLevel 0-9 (store only - best)
+  ZipOptions options;
+  options.compression_level = compressionLevel;
+  options.password = password;
+  return zip(targetFile, sourceDir, options, nullptr);
+}
+
+int zip(const char* targetFile, const char* sourceDir, const ZipOptions& options,
+        std::string* error_message) {
   int opt_overwrite = 1;// Overwrite existing zip file
-  int opt_compress_level = compressionLevel;
   char filename_try[MAXFILENAME + 16];
-  int err = 0;
-  int size_buf = 0;
-  void* buf = nullptr;
   int i, len;
   int dot_found = 0;
 
-  size_buf = WRITEBUFFERSIZE;
-  buf = (void*)malloc(size_buf);
-  if (buf == nullptr)
-    return ZIP_INTERNALERROR;
-
   strncpy(filename_try, targetFile, MAXFILENAME - 1);
   // strncpy doesnt append the trailing NULL, of the string is too long.
   filename_try[MAXFILENAME] = '\0';
@@ -306,94 +1418,74 @@ int zip(const char* targetFile, const char* sourceDir, int compressionLevel, con
     strcat(filename_try, ".zip");
   }
 
+  // The previous archive is usually the target itself, so the new archive
+  // is written next to it and only moved over it once it's complete.
+  std::unique_ptr<ArchiveReader> previous = OpenPreviousArchive(options);
+  std::string output_file = filename_try;
+  if (previous)
+    output_file += ".partial";
+
   zipFile zf;
 
+  CountingFileFunc counting;
 #ifdef USEWIN32IOAPI
-  zlib_filefunc64_def ffunc;
-  fill_win32_filefunc64A(&ffunc);
-  zf = zipOpen2_64(filename_try, (opt_overwrite == 2) ? 2 : 0, NULL, &ffunc);
+  fill_win32_filefunc64A(&counting.base);
 #else
-  zf = zipOpen64(filename_try, (opt_overwrite == 2) ? 2 : 0);
+  fill_fopen64_filefunc(&counting.base);
 #endif
+  counting.progress = options.progress;
+  zlib_filefunc64_def ffunc = counting.base;
+  if (options.progress)
+    counting.Fill(&ffunc);
+  zf = zipOpen2_64(output_file.c_str(), (opt_overwrite == 2) ? 2 : 0, NULL,
+                   &ffunc);
 
   if (zf == nullptr)
-    err = ZIP_ERRNO;
-
-  std::vector<std::string> files = GetDirectoryList(sourceDir);
-  if (files.size() <= 0) {
-    err = ZIP_PARAMERROR;
-  } else {
-    std::vector<std::string>::iterator itr;
-    for (itr = files.begin(); itr < files.end(); ++itr) {
-      const char* filenameinzip = itr->c_str();
-      const char *savefilenameinzip;
-
-      FILE * fin;
-      int size_read;
-      zip_fileinfo zi;
-      unsigned long crcFile = 0;
-      int zip64 = 0;
-
-      zi.tmz_date.tm_sec = zi.tmz_date.tm_min = zi.tmz_date.tm_hour = zi.tmz_date.tm_mday = zi.tmz_date.tm_mon = zi.tmz_date.tm_year = 0;
-      zi.dosDate = 0;
-      zi.internal_fa = 0;
-      zi.external_fa = 0;
-
-      filetime(filenameinzip, &zi.tmz_date, &zi.dosDate);
-
-      if ((password != nullptr && strlen(password) > 0) && (err == ZIP_OK))
-        err = getFileCrc(filenameinzip, buf, size_buf, &crcFile);
-
-      zip64 = isLargeFile(filenameinzip);
-
-      // The path name saved, should not include a leading slash.
-      // if it did, windows/xp and dynazip couldn't read the zip file.
-#ifdef WIN32
-      std::string baseDir = itr->substr(std::string(sourceDir).rfind('\\') + 1);
-#else
-      std::string baseDir = itr->substr(std::string(sourceDir).rfind('/') + 1);
-#endif
-
-      savefilenameinzip = baseDir.c_str();
-
-      while (savefilenameinzip[0] == '\\' || savefilenameinzip[0] == '/')
-        savefilenameinzip++;
-
-      // Using 4 for unicode compatibility (UTF8) -- tested with chinese, does not work as expected
-      err = zipOpenNewFileInZip4_64(zf, savefilenameinzip, &zi, nullptr, 0, nullptr, 0, nullptr, (opt_compress_level != 0) ? Z_DEFLATED : 0, opt_compress_level, 0, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY, password, crcFile, 36, 1 << 11, zip64);
-
-      if (err != ZIP_OK)
-        break;
-
-      fin = fopen64(filenameinzip, "rb");
-      if (fin == nullptr)
-        err = ZIP_ERRNO;
-
-      if (err == ZIP_OK) {
-        do {
-          err = ZIP_OK;
-          size_read = (int)fread(buf, 1, size_buf, fin);
-          if (size_read < size_buf)
-            if (feof(fin) == 0)
-              err = ZIP_ERRNO;
-
-          if (size_read>0) {
-            err = zipWriteInFileInZip(zf, buf, size_read);
-          }
-        } while ((err == ZIP_OK) && (size_read>0));
-      }
-      if (fin)
-        fclose(fin);
-      if (err < 0)
-        err = ZIP_ERRNO;
-      else
-        err = zipCloseFileInZip(zf);
-    }
+    return ZIP_ERRNO;
+
+  int err = ZipDirectory(zf, sourceDir, options, previous.get(),
+                         error_message);
+  int close_err = zipClose(zf, nullptr);
+  if (previous) {
+    // Windows can't replace a file that is still open.
+    previous.reset();
+    if (err == ZIP_OK)
+      err = close_err;
+    if (err == ZIP_OK)
+      err = ReplaceArchive(output_file, filename_try);
+    else
+      remove(output_file.c_str());
+  } else if (err == kArchiveCancelled) {
+    remove(output_file.c_str());
   }
-  zipClose(zf, nullptr);
-  free(buf);
   return err;
 }
 
-}  // namespace greenworks
+int zipToMemory(const char* sourceDir, const ZipOptions& options, char** data,
+                size_t* size, std::string* error_message) {
+  std::unique_ptr<ArchiveReader> previous = OpenPreviousArchive(options);
+  MemoryFile file;
+  zipFile zf = OpenMemoryArchive(&file);
+  if (zf == nullptr)
+    return ZIP_INTERNALERROR;
+  int err = ZipDirectory(zf, sourceDir, options, previous.get(),
+                         error_message);
+  return CloseMemoryArchive(zf, &file, err, data, size);
+}
 
+int zipToMemory(const std::vector<ZipMemoryEntry>& entries,
+                const ZipOptions& options, char** data, size_t* size) {
+  if (entries.empty())
+    return ZIP_PARAMERROR;
+  MemoryFile file;
+  zipFile zf = OpenMemoryArchive(&file);
+  if (zf == nullptr)
+    return ZIP_INTERNALERROR;
+  time_t now = time(nullptr);
+  int err = ZIP_OK;
+  for (size_t i = 0; i < entries.size() && err == ZIP_OK; ++i)
+    err = WriteMemoryEntry(zf, entries[i], now, options);
+  return CloseMemoryArchive(zf, &file, err, data, size);
+}
+
+}  // namespace greenworks
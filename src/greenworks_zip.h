@@ -19,9 +19,85 @@
 #ifndef GREENWORKS_ZIP_H_
 #define GREENWORKS_ZIP_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "greenworks_archive_progress.h"
+
 namespace greenworks {
 
+// What zip() did with one file.
+struct ZipEntryReport {
+  std::string name;
+  uint64_t size;
+  // Whether it was stored uncompressed because it looked incompressible.
+  bool stored;
+};
+
+struct ZipReport {
+  ZipReport() : stored_bytes(0) {}
+
+  // In the order the files were written.
+  std::vector<ZipEntryReport> entries;
+  // Total size of the files that were stored instead of deflated.
+  uint64_t stored_bytes;
+};
+
+struct ZipOptions {
+  ZipOptions()
+      : compression_level(6),
+        password(nullptr),
+        threads(1),
+        previous_archive(nullptr),
+        store_incompressible(false),
+        report(nullptr),
+        progress(nullptr) {}
+
+  // 0-9, store only - best compressed.
+  int compression_level;
+  const char* password;
+  // Number of threads deflating entries in parallel, 0 for one per CPU core.
+  // With 1, entries are compressed one after another on the calling thread.
+  int threads;
+  // An earlier archive of the same directory, may be the target itself.
+  // Files whose size, date and CRC match its entries are copied from it
+  // without being compressed again. Ignored when |password| is set.
+  const char* previous_archive;
+  // Stores files without compression if they are in a format that is
+  // compressed already (PNG, OGG, MP4, ZIP, ...), or if deflating their
+  // first few KB barely makes them smaller.
+  bool store_incompressible;
+  // Filled in with every file written, if not null.
+  ZipReport* report;
+  // Updated as files are written, if not null. Cancelling it makes zip()
+  // delete the unfinished archive and return kArchiveCancelled.
+  ArchiveProgress* progress;
+};
+
 int zip(const char* targetFile, const char* sourceDir, int compressionLevel, const char* password);
+// Returns ZIP_OK (0) on success. If |sourceDir| or one of its subdirectories
+// can't be read, |error_message| (if not null) describes which one.
+int zip(const char* targetFile, const char* sourceDir, const ZipOptions& options,
+        std::string* error_message);
+
+// A file added to an archive by zipToMemory(). |data| must stay valid until
+// zipToMemory() returns.
+struct ZipMemoryEntry {
+  std::string name;
+  const char* data;
+  size_t size;
+};
+
+// Like zip(), but builds the archive in memory. On success, |data| points to
+// the archive, allocated with malloc() and owned by the caller.
+int zipToMemory(const char* sourceDir, const ZipOptions& options, char** data,
+                size_t* size, std::string* error_message);
+// Builds an archive of |entries| in memory, stamped with the current time.
+// |options.threads| is ignored.
+int zipToMemory(const std::vector<ZipMemoryEntry>& entries,
+                const ZipOptions& options, char** data, size_t* size);
 
 }
 
@@ -7,10 +7,17 @@
 #include "v8.h"
 
 #include "steam/steam_api.h"
-#include "greenworks_utils.h"
+#include "steam_client.h"
+#include "steam_dispatcher.h"
 
 namespace greenworks {
 
+namespace {
+
+const uint64_t kTimeoutMs = 60000;
+
+}  // namespace
+
 SteamAsyncWorker::SteamAsyncWorker(Nan::Callback* success_callback,
     Nan::Callback* error_callback): Nan::AsyncWorker(success_callback),
                                     error_callback_(error_callback) {
@@ -31,24 +38,88 @@ void SteamAsyncWorker::HandleErrorCallback() {
 SteamCallbackAsyncWorker::SteamCallbackAsyncWorker(
     Nan::Callback* success_callback, Nan::Callback* error_callback):
         SteamAsyncWorker(success_callback, error_callback),
+        is_timeout_(true),
         is_completed_(false),
-        time_elapsed_(0),
-        is_timeout_(true) {
-}
-
-void SteamCallbackAsyncWorker::WaitForCompleted() {
-  while (!is_completed_) {
-    // sleep 100ms.
-    utils::sleep(100);
-
-    if(is_timeout_) {
-        time_elapsed_ += 100;
-        if(time_elapsed_ > 60000) {
-            SetErrorMessage("SteamCallbackAsyncWorker timed out after 60 seconds.");
-            return;
-        }
-    }
+        closed_handles_(0) {
+}
+
+void SteamCallbackAsyncWorker::Queue(SteamCallbackAsyncWorker* worker) {
+  uv_async_init(uv_default_loop(), &worker->completed_async_,
+                &SteamCallbackAsyncWorker::OnCompletedAsync);
+  worker->completed_async_.data = worker;
+  uv_timer_init(uv_default_loop(), &worker->timeout_timer_);
+  worker->timeout_timer_.data = worker;
+  if (worker->is_timeout_) {
+    uv_timer_start(&worker->timeout_timer_,
+                   &SteamCallbackAsyncWorker::OnTimeout, kTimeoutMs, 0);
   }
+
+  SteamClient::AddPendingCallResult();
+
+  worker->Execute();
+  if (worker->ErrorMessage())
+    worker->SetCompleted();
+}
+
+void SteamCallbackAsyncWorker::SetCompleted() {
+  if (is_completed_.exchange(true))
+    return;
+  uv_async_send(&completed_async_);
+}
+
+void SteamCallbackAsyncWorker::WatchCallResult(CCallbackBase* call_result,
+                                               SteamAPICall_t api_call) {
+  if (!SteamDispatcher::IsRunning())
+    return;
+  SteamDispatcher::RegisterCallResult(call_result, api_call);
+  watched_call_results_.push_back(call_result);
+}
+
+void SteamCallbackAsyncWorker::WatchCallback(CCallbackBase* callback) {
+  if (!SteamDispatcher::IsRunning())
+    return;
+  SteamDispatcher::RegisterCallback(callback);
+  watched_callbacks_.push_back(callback);
+}
+
+NAUV_WORK_CB(SteamCallbackAsyncWorker::OnCompletedAsync) {
+  static_cast<SteamCallbackAsyncWorker*>(async->data)->Finish();
+}
+
+#if NAUV_UVVERSION < 0x000b17
+void SteamCallbackAsyncWorker::OnTimeout(uv_timer_t* handle, int status_code) {
+#else
+void SteamCallbackAsyncWorker::OnTimeout(uv_timer_t* handle) {
+#endif
+  auto* worker = static_cast<SteamCallbackAsyncWorker*>(handle->data);
+  if (worker->is_completed_.exchange(true))
+    return;
+  worker->SetErrorMessage(
+      "SteamCallbackAsyncWorker timed out after 60 seconds.");
+  worker->Finish();
+}
+
+void SteamCallbackAsyncWorker::Finish() {
+  SteamClient::RemovePendingCallResult();
+  for (CCallbackBase* callback : watched_callbacks_)
+    SteamDispatcher::UnregisterCallback(callback);
+  for (CCallbackBase* call_result : watched_call_results_)
+    SteamDispatcher::UnregisterCallResult(call_result);
+  uv_timer_stop(&timeout_timer_);
+  uv_close(reinterpret_cast<uv_handle_t*>(&timeout_timer_),
+           &SteamCallbackAsyncWorker::OnHandleClosed);
+  uv_close(reinterpret_cast<uv_handle_t*>(&completed_async_),
+           &SteamCallbackAsyncWorker::OnHandleClosed);
+}
+
+void SteamCallbackAsyncWorker::OnHandleClosed(uv_handle_t* handle) {
+  auto* worker = static_cast<SteamCallbackAsyncWorker*>(handle->data);
+  // Both handles live inside the worker, so it can only go away once the
+  // last one has been closed.
+  if (++worker->closed_handles_ < 2)
+    return;
+  worker->WorkComplete();
+  worker->Destroy();
 }
 
 }  // namespace greenworks
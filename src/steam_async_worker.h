@@ -5,7 +5,11 @@
 #ifndef SRC_STEAM_ASYNC_WORKER_H_
 #define SRC_STEAM_ASYNC_WORKER_H_
 
+#include <atomic>
+#include <vector>
+
 #include "nan.h"
+#include "steam/steam_api.h"
 
 namespace greenworks {
 
@@ -24,17 +28,53 @@ class SteamAsyncWorker : public Nan::AsyncWorker {
 };
 
 // An abstract SteamAsyncWorker for Steam callback API.
+//
+// Unlike other workers it doesn't run on the libuv threadpool: Execute() is
+// called on the main thread and only issues the Steam call and registers its
+// CCallResult/STEAM_CALLBACK. The handler then calls SetCompleted(), which
+// brings the worker back to the main loop through a uv_async_t to run the JS
+// callbacks. Workers must be started with Queue() instead of
+// Nan::AsyncQueueWorker().
 class SteamCallbackAsyncWorker : public SteamAsyncWorker {
  public:
   SteamCallbackAsyncWorker(Nan::Callback* success_callback,
       Nan::Callback* error_callback);
 
-  void WaitForCompleted();
+  static void Queue(SteamCallbackAsyncWorker* worker);
 
  protected:
-  bool is_completed_;
+  // Marks the Steam request as done. If Execute() sets an error message
+  // without calling it, the worker is completed right away since no result
+  // will arrive.
+  void SetCompleted();
+
+  // Steam doesn't run CCallResult and STEAM_CALLBACK members by itself while
+  // callbacks are dispatched on a background thread (see SteamDispatcher), so
+  // workers pass them here once they are set up. They are released when the
+  // worker finishes.
+  void WatchCallResult(CCallbackBase* call_result, SteamAPICall_t api_call);
+  void WatchCallback(CCallbackBase* callback);
+
+  // Fails the worker if no result arrives within 60 seconds.
   bool is_timeout_;
-  uint32_t time_elapsed_;
+
+ private:
+  static NAUV_WORK_CB(OnCompletedAsync);
+#if NAUV_UVVERSION < 0x000b17
+  static void OnTimeout(uv_timer_t* handle, int status_code);
+#else
+  static void OnTimeout(uv_timer_t* handle);
+#endif
+  static void OnHandleClosed(uv_handle_t* handle);
+
+  void Finish();
+
+  std::vector<CCallbackBase*> watched_callbacks_;
+  std::vector<CCallbackBase*> watched_call_results_;
+  uv_async_t completed_async_;
+  uv_timer_t timeout_timer_;
+  std::atomic<bool> is_completed_;
+  int closed_handles_;
 };
 
 }  // namespace greenworks
@@ -5,9 +5,12 @@
 #include "steam_client.h"
 
 #include <algorithm>
+#include <atomic>
 
 #include "nan.h"
 
+#include "steam_dispatcher.h"
+
 namespace greenworks {
 
 namespace {
@@ -15,17 +18,60 @@ namespace {
 SteamClient* g_steam_client = nullptr;
 uv_timer_t* g_steam_timer = nullptr;
 
+SteamClient::LoopOptions g_loop_options = {
+    /*fast_interval_ms=*/16, /*idle_interval_ms=*/250, /*unref=*/false,
+    /*dispatch_thread=*/false};
+uint64_t g_loop_interval_ms = 16;
+// Also read by the SteamDispatcher thread.
+std::atomic<int> g_pending_call_results(0);
+// Number of Steam events dispatched to observers since the last tick.
+int g_dispatched_events = 0;
+
+uint64_t g_ticks = 0;
+uint64_t g_last_tick_cost_ns = 0;
+uint64_t g_total_tick_cost_ns = 0;
+uint64_t g_max_tick_cost_ns = 0;
+
 void on_timer_close_complete(uv_handle_t* handle) {
   delete reinterpret_cast<uv_timer_t*>(handle);
 }
 
 // uv v0.11.23 has changed uv_timer_cb interface by removing status_code.
+#if NAUV_UVVERSION < 0x000b17
+void RunSteamAPICallback(uv_timer_t* handle, int status_code);
+#else
+void RunSteamAPICallback(uv_timer_t* handle);
+#endif
+
+void SetLoopInterval(uint64_t interval_ms) {
+  if (!g_steam_timer || interval_ms == g_loop_interval_ms)
+    return;
+  g_loop_interval_ms = interval_ms;
+  uv_timer_start(g_steam_timer, &RunSteamAPICallback, interval_ms,
+                 interval_ms);
+}
+
 #if NAUV_UVVERSION < 0x000b17
 void RunSteamAPICallback(uv_timer_t* handle, int status_code) {
 #else
 void RunSteamAPICallback(uv_timer_t* handle) {
 #endif
+  g_dispatched_events = 0;
+  uint64_t start = uv_hrtime();
   SteamAPI_RunCallbacks();
+  uint64_t cost = uv_hrtime() - start;
+
+  ++g_ticks;
+  g_last_tick_cost_ns = cost;
+  g_total_tick_cost_ns += cost;
+  g_max_tick_cost_ns = std::max(g_max_tick_cost_ns, cost);
+
+  if (g_pending_call_results > 0 || g_dispatched_events > 0) {
+    SetLoopInterval(g_loop_options.fast_interval_ms);
+  } else {
+    SetLoopInterval(std::min(g_loop_interval_ms * 2,
+                             g_loop_options.idle_interval_ms));
+  }
 }
 
 }  // namespace
@@ -56,10 +102,13 @@ SteamClient::SteamClient()
       OnNewUrlLaunchParameters_(this, &SteamClient::OnNewUrlLaunchParameters) {}
 
 SteamClient::~SteamClient() {
+  // Stop() runs the queued callbacks, which notify the observers.
+  SteamDispatcher::Stop();
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     delete observer_list_[i];
   }
-  if (g_steam_client) {
+  observer_list_.clear();
+  if (g_steam_timer) {
     uv_timer_stop(g_steam_timer);
     uv_close(reinterpret_cast<uv_handle_t*>(g_steam_timer),
              on_timer_close_complete);
@@ -74,6 +123,7 @@ SteamClient* SteamClient::GetInstance() {
 }
 
 void SteamClient::OnGameOverlayActivated(GameOverlayActivated_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnGameOverlayActivated(
         static_cast<bool>(callback->m_bActive));
@@ -81,6 +131,7 @@ void SteamClient::OnGameOverlayActivated(GameOverlayActivated_t* callback) {
 }
 
 void SteamClient::OnSteamServersConnected(SteamServersConnected_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnSteamServersConnected();
   }
@@ -88,6 +139,7 @@ void SteamClient::OnSteamServersConnected(SteamServersConnected_t* callback) {
 
 void SteamClient::OnSteamServersDisconnected(
     SteamServersDisconnected_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnSteamServersDisconnected();
   }
@@ -95,6 +147,7 @@ void SteamClient::OnSteamServersDisconnected(
 
 void SteamClient::OnSteamServerConnectFailure(
     SteamServerConnectFailure_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnSteamServerConnectFailure(
         static_cast<int>(callback->m_eResult));
@@ -102,12 +155,14 @@ void SteamClient::OnSteamServerConnectFailure(
 }
 
 void SteamClient::OnSteamShutdown(SteamShutdown_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnSteamShutdown();
   }
 }
 
 void SteamClient::OnPeronaStateChange(PersonaStateChange_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnPersonaStateChange(callback->m_ulSteamID,
                                             callback->m_nChangeFlags);
@@ -115,6 +170,7 @@ void SteamClient::OnPeronaStateChange(PersonaStateChange_t* callback) {
 }
 
 void SteamClient::OnAvatarImageLoaded(AvatarImageLoaded_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnAvatarImageLoaded(
         callback->m_steamID.ConvertToUint64(), callback->m_iImage,
@@ -124,6 +180,7 @@ void SteamClient::OnAvatarImageLoaded(AvatarImageLoaded_t* callback) {
 
 void SteamClient::OnGameConnectedFriendChatMessage(
     GameConnectedFriendChatMsg_t* callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnGameConnectedFriendChatMessage(
         callback->m_steamIDUser.ConvertToUint64(), callback->m_iMessageID);
@@ -131,6 +188,7 @@ void SteamClient::OnGameConnectedFriendChatMessage(
 }
 
 void SteamClient::OnDLCInstalled(DlcInstalled_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnDLCInstalled(
         callback->m_nAppID);
@@ -139,6 +197,7 @@ void SteamClient::OnDLCInstalled(DlcInstalled_t *callback) {
 
 void SteamClient::OnMicroTxnAuthorizationResponse(
                           MicroTxnAuthorizationResponse_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnMicroTxnAuthorizationResponse(
         callback->m_unAppID, callback->m_ulOrderID,
@@ -147,6 +206,7 @@ void SteamClient::OnMicroTxnAuthorizationResponse(
 }
 
 void SteamClient::OnLobbyCreated(LobbyCreated_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnLobbyCreated(
         static_cast<int>(callback->m_eResult),
@@ -155,6 +215,7 @@ void SteamClient::OnLobbyCreated(LobbyCreated_t *callback) {
 }
 
 void SteamClient::OnLobbyDataUpdate(LobbyDataUpdate_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnLobbyDataUpdate(
         callback->m_ulSteamIDLobby,
@@ -164,6 +225,7 @@ void SteamClient::OnLobbyDataUpdate(LobbyDataUpdate_t *callback) {
 }
 
 void SteamClient::OnLobbyEnter(LobbyEnter_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnLobbyEnter(
         callback->m_ulSteamIDLobby,
@@ -174,6 +236,7 @@ void SteamClient::OnLobbyEnter(LobbyEnter_t *callback) {
 }
 
 void SteamClient::OnLobbyInvite(LobbyInvite_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnLobbyInvite(
         callback->m_ulSteamIDUser,
@@ -183,6 +246,7 @@ void SteamClient::OnLobbyInvite(LobbyInvite_t *callback) {
 }
 
 void SteamClient::OnGameLobbyJoinRequested(GameLobbyJoinRequested_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnGameLobbyJoinRequested(
         callback->m_steamIDLobby.ConvertToUint64(),
@@ -191,6 +255,7 @@ void SteamClient::OnGameLobbyJoinRequested(GameLobbyJoinRequested_t *callback) {
 }
 
 void SteamClient::OnGameRichPresenceJoinRequested(GameRichPresenceJoinRequested_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnGameRichPresenceJoinRequested(
       callback->m_steamIDFriend.ConvertToUint64(),
@@ -199,18 +264,115 @@ void SteamClient::OnGameRichPresenceJoinRequested(GameRichPresenceJoinRequested_
 }
 
 void SteamClient::OnNewUrlLaunchParameters(NewUrlLaunchParameters_t *callback) {
+  ++g_dispatched_events;
   for (size_t i = 0; i < observer_list_.size(); ++i) {
     observer_list_[i]->OnNewUrlLaunchParameters();
   }
 }
 
+void SteamClient::RegisterDispatcherCallbacks() {
+  CCallbackBase* callbacks[] = {
+      &game_overlay_activated_,
+      &steam_servers_connected_,
+      &steam_servers_disconnected_,
+      &steam_server_connect_failure_,
+      &steam_shutdown_,
+      &steam_persona_state_change_,
+      &avatar_image_loaded_,
+      &game_connected_friend_chat_msg_,
+      &dlc_installed_,
+      &MicroTxnAuthorizationResponse_,
+      &OnLobbyCreated_,
+      &OnLobbyDataUpdate_,
+      &OnLobbyEnter_,
+      &OnLobbyInvite_,
+      &OnGameLobbyJoinRequested_,
+      &OnGameRichPresenceJoinRequested_,
+      &OnNewUrlLaunchParameters_,
+  };
+  for (CCallbackBase* callback : callbacks)
+    SteamDispatcher::RegisterCallback(callback);
+}
+
 void SteamClient::StartSteamLoop() {
-  if (g_steam_timer)
+  if (IsSteamLoopStarted())
+    return;
+  SteamClient* client = SteamClient::GetInstance();
+  if (g_loop_options.dispatch_thread &&
+      SteamDispatcher::Start(g_loop_options)) {
+    client->RegisterDispatcherCallbacks();
     return;
-  SteamClient::GetInstance();
+  }
   g_steam_timer = new uv_timer_t();
   uv_timer_init(uv_default_loop(), g_steam_timer);
-  uv_timer_start(g_steam_timer, &RunSteamAPICallback, 0, 100);
+  if (g_loop_options.unref)
+    uv_unref(reinterpret_cast<uv_handle_t*>(g_steam_timer));
+  g_loop_interval_ms = g_loop_options.fast_interval_ms;
+  uv_timer_start(g_steam_timer, &RunSteamAPICallback, 0, g_loop_interval_ms);
+}
+
+bool SteamClient::IsSteamLoopStarted() {
+  return g_steam_timer || SteamDispatcher::IsRunning();
+}
+
+SteamClient::LoopOptions SteamClient::GetLoopOptions() {
+  return g_loop_options;
+}
+
+void SteamClient::SetLoopOptions(const LoopOptions& options) {
+  g_loop_options = options;
+  g_loop_options.fast_interval_ms =
+      std::max<uint64_t>(g_loop_options.fast_interval_ms, 1);
+  g_loop_options.idle_interval_ms = std::max(g_loop_options.idle_interval_ms,
+                                             g_loop_options.fast_interval_ms);
+  SteamDispatcher::SetOptions(g_loop_options);
+  if (!g_steam_timer)
+    return;
+  auto* handle = reinterpret_cast<uv_handle_t*>(g_steam_timer);
+  if (g_loop_options.unref)
+    uv_unref(handle);
+  else
+    uv_ref(handle);
+  SetLoopInterval(g_loop_options.fast_interval_ms);
+}
+
+SteamClient::LoopStats SteamClient::GetLoopStats() {
+  uint64_t interval_ms = g_loop_interval_ms;
+  uint64_t ticks = g_ticks;
+  uint64_t last_tick_cost_ns = g_last_tick_cost_ns;
+  uint64_t total_tick_cost_ns = g_total_tick_cost_ns;
+  uint64_t max_tick_cost_ns = g_max_tick_cost_ns;
+  if (SteamDispatcher::IsRunning()) {
+    SteamDispatcher::Stats dispatcher_stats = SteamDispatcher::GetStats();
+    interval_ms = dispatcher_stats.interval_ms;
+    ticks = dispatcher_stats.ticks;
+    last_tick_cost_ns = dispatcher_stats.last_tick_cost_ns;
+    total_tick_cost_ns = dispatcher_stats.total_tick_cost_ns;
+    max_tick_cost_ns = dispatcher_stats.max_tick_cost_ns;
+  }
+
+  LoopStats stats;
+  stats.interval_ms = interval_ms;
+  stats.ticks = ticks;
+  stats.last_tick_cost_us = last_tick_cost_ns / 1000;
+  stats.average_tick_cost_us = ticks ? total_tick_cost_ns / ticks / 1000 : 0;
+  stats.max_tick_cost_us = max_tick_cost_ns / 1000;
+  stats.pending_call_results = g_pending_call_results;
+  return stats;
+}
+
+void SteamClient::AddPendingCallResult() {
+  ++g_pending_call_results;
+  SetLoopInterval(g_loop_options.fast_interval_ms);
+  SteamDispatcher::Wake();
+}
+
+void SteamClient::RemovePendingCallResult() {
+  --g_pending_call_results;
+}
+
+bool SteamClient::HasPendingCallResults() {
+  return g_pending_call_results > 0;
 }
 
 void SteamClient::AddObserver(Observer* observer) {
@@ -45,15 +45,53 @@ class SteamClient {
     virtual ~Observer() {}
   };
 
+  // Controls how often the Steam loop runs SteamAPI_RunCallbacks(). The loop
+  // runs every |fast_interval_ms| while call results are outstanding or
+  // events are being dispatched, and otherwise doubles its interval on each
+  // idle tick up to |idle_interval_ms|.
+  struct LoopOptions {
+    uint64_t fast_interval_ms;
+    uint64_t idle_interval_ms;
+    // Don't keep the event loop alive only for the Steam loop.
+    bool unref;
+    // Run Steam callbacks on a native thread with SteamDispatcher. Only
+    // takes effect if set before the loop is started.
+    bool dispatch_thread;
+  };
+
+  struct LoopStats {
+    uint64_t interval_ms;
+    uint64_t ticks;
+    uint64_t last_tick_cost_us;
+    uint64_t average_tick_cost_us;
+    uint64_t max_tick_cost_us;
+    int pending_call_results;
+  };
+
   void AddObserver(Observer* observer);
 
   static SteamClient* GetInstance();
   static void StartSteamLoop();
+  static bool IsSteamLoopStarted();
+
+  static LoopOptions GetLoopOptions();
+  static void SetLoopOptions(const LoopOptions& options);
+  static LoopStats GetLoopStats();
+
+  // Tracks the Steam call results that are being waited for, so the loop
+  // stays on the fast interval until they are delivered.
+  static void AddPendingCallResult();
+  static void RemovePendingCallResult();
+  static bool HasPendingCallResults();
 
  private:
   SteamClient();
   ~SteamClient();
 
+  // Hands the STEAM_CALLBACK members below over to SteamDispatcher, which
+  // runs them instead of SteamAPI_RunCallbacks().
+  void RegisterDispatcherCallbacks();
+
   // SteamClient owns observer object
   std::vector<Observer*> observer_list_;
 
@@ -0,0 +1,362 @@
+// Copyright (c) 2015 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#include "steam_dispatcher.h"
+
+#if defined(GREENWORKS_MANUAL_DISPATCH)
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#include "nan.h"
+
+namespace greenworks {
+
+#if defined(GREENWORKS_MANUAL_DISPATCH)
+
+namespace {
+
+const size_t kInlineDataSize = 64;
+// Must be a power of two.
+const size_t kQueueSize = 1024;
+
+// A callback or call result copied out of Steam's dispatch buffer.
+struct DispatchRecord {
+  int callback_id;
+  // k_uAPICallInvalid for callbacks.
+  SteamAPICall_t api_call;
+  bool io_failure;
+  uint32 size;
+  // Set when the payload doesn't fit in |inline_data|.
+  uint8* heap_data;
+  alignas(8) uint8 inline_data[kInlineDataSize];
+
+  uint8* data() { return heap_data ? heap_data : inline_data; }
+};
+
+// Written by the dispatch thread at |g_queue_tail| and read by the main
+// thread at |g_queue_head|.
+DispatchRecord g_queue[kQueueSize];
+std::atomic<size_t> g_queue_head(0);
+std::atomic<size_t> g_queue_tail(0);
+
+std::thread* g_dispatch_thread = nullptr;
+uv_async_t* g_drain_async = nullptr;
+std::atomic<bool> g_running(false);
+
+std::mutex g_wake_mutex;
+std::condition_variable g_wake_condition;
+bool g_wake_requested = false;
+
+std::atomic<uint64_t> g_fast_interval_ms(16);
+std::atomic<uint64_t> g_idle_interval_ms(250);
+std::atomic<uint64_t> g_interval_ms(16);
+std::atomic<uint64_t> g_ticks(0);
+std::atomic<uint64_t> g_last_tick_cost_ns(0);
+std::atomic<uint64_t> g_total_tick_cost_ns(0);
+std::atomic<uint64_t> g_max_tick_cost_ns(0);
+
+// Main thread only.
+std::vector<CCallbackBase*> g_callbacks;
+std::unordered_map<SteamAPICall_t, CCallbackBase*> g_call_results;
+
+uint8* AllocateData(DispatchRecord* record, uint32 size) {
+  record->size = size;
+  record->heap_data = size > kInlineDataSize
+                          ? static_cast<uint8*>(malloc(size))
+                          : nullptr;
+  return record->data();
+}
+
+bool PushRecord(const DispatchRecord& record) {
+  size_t tail = g_queue_tail.load(std::memory_order_relaxed);
+  if (tail - g_queue_head.load(std::memory_order_acquire) == kQueueSize)
+    return false;
+  g_queue[tail & (kQueueSize - 1)] = record;
+  g_queue_tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool PopRecord(DispatchRecord* record) {
+  size_t head = g_queue_head.load(std::memory_order_relaxed);
+  if (head == g_queue_tail.load(std::memory_order_acquire))
+    return false;
+  *record = g_queue[head & (kQueueSize - 1)];
+  g_queue_head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+void DispatchRecordToListeners(DispatchRecord* record) {
+  if (record->api_call != k_uAPICallInvalid) {
+    auto it = g_call_results.find(record->api_call);
+    if (it == g_call_results.end())
+      return;
+    CCallbackBase* call_result = it->second;
+    g_call_results.erase(it);
+    call_result->Run(record->data(), record->io_failure, record->api_call);
+    return;
+  }
+
+  // Handlers may register or unregister callbacks while running.
+  std::vector<CCallbackBase*> callbacks;
+  for (CCallbackBase* callback : g_callbacks) {
+    if (callback->GetICallback() == record->callback_id &&
+        callback->GetCallbackSizeBytes() <= static_cast<int>(record->size)) {
+      callbacks.push_back(callback);
+    }
+  }
+  for (CCallbackBase* callback : callbacks) {
+    if (std::find(g_callbacks.begin(), g_callbacks.end(), callback) !=
+        g_callbacks.end()) {
+      callback->Run(record->data());
+    }
+  }
+}
+
+void DrainQueue() {
+  Nan::HandleScope scope;
+  DispatchRecord record;
+  while (PopRecord(&record)) {
+    DispatchRecordToListeners(&record);
+    free(record.heap_data);
+  }
+}
+
+NAUV_WORK_CB(OnDrainAsync) {
+  DrainQueue();
+}
+
+void OnDrainAsyncClosed(uv_handle_t* handle) {
+  delete reinterpret_cast<uv_async_t*>(handle);
+}
+
+// Returns true if the thread was woken up by Wake() or Stop().
+bool WaitForNextFrame(uint64_t interval_ms) {
+  std::unique_lock<std::mutex> lock(g_wake_mutex);
+  bool woken = g_wake_condition.wait_for(
+      lock, std::chrono::milliseconds(interval_ms),
+      [] { return g_wake_requested || !g_running.load(); });
+  g_wake_requested = false;
+  return woken;
+}
+
+void QueueRecord(const DispatchRecord& record) {
+  // Events are never dropped; wait for the main thread to catch up instead.
+  while (!PushRecord(record)) {
+    uv_async_send(g_drain_async);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void RunDispatchThread(HSteamPipe pipe) {
+  uint64_t interval_ms = g_fast_interval_ms.load();
+  while (g_running.load()) {
+    uint64_t start = uv_hrtime();
+    SteamAPI_ManualDispatch_RunFrame(pipe);
+
+    int queued = 0;
+    CallbackMsg_t message;
+    while (SteamAPI_ManualDispatch_GetNextCallback(pipe, &message)) {
+      DispatchRecord record;
+      record.io_failure = false;
+      if (message.m_iCallback == SteamAPICallCompleted_t::k_iCallback) {
+        const auto* completed =
+            reinterpret_cast<SteamAPICallCompleted_t*>(message.m_pubParam);
+        record.callback_id = completed->m_iCallback;
+        record.api_call = completed->m_hAsyncCall;
+        uint8* data = AllocateData(&record, completed->m_cubParam);
+        bool failed = false;
+        if (!SteamAPI_ManualDispatch_GetAPICallResult(
+                pipe, record.api_call, data, record.size,
+                record.callback_id, &failed)) {
+          failed = true;
+        }
+        record.io_failure = failed;
+      } else {
+        record.callback_id = message.m_iCallback;
+        record.api_call = k_uAPICallInvalid;
+        memcpy(AllocateData(&record, message.m_cubParam), message.m_pubParam,
+               message.m_cubParam);
+      }
+      SteamAPI_ManualDispatch_FreeLastCallback(pipe);
+      QueueRecord(record);
+      ++queued;
+    }
+    if (queued > 0)
+      uv_async_send(g_drain_async);
+
+    uint64_t cost = uv_hrtime() - start;
+    ++g_ticks;
+    g_last_tick_cost_ns = cost;
+    g_total_tick_cost_ns += cost;
+    if (cost > g_max_tick_cost_ns.load())
+      g_max_tick_cost_ns = cost;
+
+    if (queued > 0 || SteamClient::HasPendingCallResults()) {
+      interval_ms = g_fast_interval_ms.load();
+    } else {
+      interval_ms =
+          std::min(interval_ms * 2, g_idle_interval_ms.load());
+    }
+    g_interval_ms = interval_ms;
+    if (WaitForNextFrame(interval_ms))
+      interval_ms = g_fast_interval_ms.load();
+  }
+}
+
+}  // namespace
+
+bool SteamDispatcher::IsSupported() {
+  return true;
+}
+
+bool SteamDispatcher::IsRunning() {
+  return g_dispatch_thread != nullptr;
+}
+
+bool SteamDispatcher::Start(const SteamClient::LoopOptions& options) {
+  if (g_dispatch_thread)
+    return true;
+  HSteamPipe pipe = SteamAPI_GetHSteamPipe();
+  if (!pipe)
+    return false;
+  SteamAPI_ManualDispatch_Init();
+
+  g_drain_async = new uv_async_t();
+  uv_async_init(uv_default_loop(), g_drain_async, &OnDrainAsync);
+  SetOptions(options);
+  g_interval_ms = options.fast_interval_ms;
+
+  g_running = true;
+  g_dispatch_thread = new std::thread(&RunDispatchThread, pipe);
+  return true;
+}
+
+void SteamDispatcher::Stop() {
+  if (!g_dispatch_thread)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(g_wake_mutex);
+    g_running = false;
+  }
+  g_wake_condition.notify_one();
+  g_dispatch_thread->join();
+  delete g_dispatch_thread;
+  g_dispatch_thread = nullptr;
+
+  DrainQueue();
+  uv_close(reinterpret_cast<uv_handle_t*>(g_drain_async), &OnDrainAsyncClosed);
+  g_drain_async = nullptr;
+  g_callbacks.clear();
+  g_call_results.clear();
+}
+
+void SteamDispatcher::SetOptions(const SteamClient::LoopOptions& options) {
+  g_fast_interval_ms = options.fast_interval_ms;
+  g_idle_interval_ms = options.idle_interval_ms;
+  if (!g_drain_async)
+    return;
+  auto* handle = reinterpret_cast<uv_handle_t*>(g_drain_async);
+  if (options.unref)
+    uv_unref(handle);
+  else
+    uv_ref(handle);
+  Wake();
+}
+
+void SteamDispatcher::Wake() {
+  if (!g_dispatch_thread)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(g_wake_mutex);
+    g_wake_requested = true;
+  }
+  g_wake_condition.notify_one();
+}
+
+SteamDispatcher::Stats SteamDispatcher::GetStats() {
+  Stats stats;
+  stats.interval_ms = g_interval_ms;
+  stats.ticks = g_ticks;
+  stats.last_tick_cost_ns = g_last_tick_cost_ns;
+  stats.total_tick_cost_ns = g_total_tick_cost_ns;
+  stats.max_tick_cost_ns = g_max_tick_cost_ns;
+  return stats;
+}
+
+void SteamDispatcher::RegisterCallback(CCallbackBase* callback) {
+  if (!g_dispatch_thread)
+    return;
+  if (std::find(g_callbacks.begin(), g_callbacks.end(), callback) ==
+      g_callbacks.end()) {
+    g_callbacks.push_back(callback);
+  }
+}
+
+void SteamDispatcher::UnregisterCallback(CCallbackBase* callback) {
+  g_callbacks.erase(
+      std::remove(g_callbacks.begin(), g_callbacks.end(), callback),
+      g_callbacks.end());
+}
+
+void SteamDispatcher::RegisterCallResult(CCallbackBase* call_result,
+                                         SteamAPICall_t api_call) {
+  if (!g_dispatch_thread || api_call == k_uAPICallInvalid)
+    return;
+  g_call_results[api_call] = call_result;
+}
+
+void SteamDispatcher::UnregisterCallResult(CCallbackBase* call_result) {
+  for (auto it = g_call_results.begin(); it != g_call_results.end();) {
+    if (it->second == call_result)
+      it = g_call_results.erase(it);
+    else
+      ++it;
+  }
+}
+
+#else  // !defined(GREENWORKS_MANUAL_DISPATCH)
+
+bool SteamDispatcher::IsSupported() {
+  return false;
+}
+
+bool SteamDispatcher::IsRunning() {
+  return false;
+}
+
+bool SteamDispatcher::Start(const SteamClient::LoopOptions& options) {
+  return false;
+}
+
+void SteamDispatcher::Stop() {}
+
+void SteamDispatcher::SetOptions(const SteamClient::LoopOptions& options) {}
+
+void SteamDispatcher::Wake() {}
+
+SteamDispatcher::Stats SteamDispatcher::GetStats() {
+  return Stats();
+}
+
+void SteamDispatcher::RegisterCallback(CCallbackBase* callback) {}
+
+void SteamDispatcher::UnregisterCallback(CCallbackBase* callback) {}
+
+void SteamDispatcher::RegisterCallResult(CCallbackBase* call_result,
+                                         SteamAPICall_t api_call) {}
+
+void SteamDispatcher::UnregisterCallResult(CCallbackBase* call_result) {}
+
+#endif  // defined(GREENWORKS_MANUAL_DISPATCH)
+
+}  // namespace greenworks
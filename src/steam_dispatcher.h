@@ -0,0 +1,62 @@
+// Copyright (c) 2015 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+#ifndef SRC_STEAM_DISPATCHER_H_
+#define SRC_STEAM_DISPATCHER_H_
+
+#include "steam/steam_api.h"
+#include "steam_client.h"
+
+namespace greenworks {
+
+// Runs Steam callbacks on a native thread with the SteamAPI_ManualDispatch_*
+// API instead of calling SteamAPI_RunCallbacks() on the main thread.
+//
+// The thread copies every callback and call result into a fixed-size record
+// and pushes it to a single-producer/single-consumer ring. The main loop is
+// woken with a uv_async_t and drains all queued records in one go, running
+// the registered CCallback/CCallResult objects there, so JS still only sees
+// events on the main thread.
+//
+// Steam doesn't run CCallback/CCallResult objects in manual dispatch mode, so
+// they must be registered here as well. The manual dispatch API needs v1.48
+// of the SDK or later; it is only compiled in when GREENWORKS_MANUAL_DISPATCH
+// is defined (the `steam_manual_dispatch` gyp variable).
+class SteamDispatcher {
+ public:
+  struct Stats {
+    uint64_t interval_ms;
+    uint64_t ticks;
+    uint64_t last_tick_cost_ns;
+    uint64_t total_tick_cost_ns;
+    uint64_t max_tick_cost_ns;
+  };
+
+  static bool IsSupported();
+  static bool IsRunning();
+
+  // Must be called on the main thread after SteamAPI_Init(). Returns false if
+  // manual dispatch isn't available, in which case the caller should keep
+  // using SteamAPI_RunCallbacks().
+  static bool Start(const SteamClient::LoopOptions& options);
+  static void Stop();
+
+  // Applies the loop intervals and unref option to the dispatch thread.
+  static void SetOptions(const SteamClient::LoopOptions& options);
+  // Makes the dispatch thread run a frame now and go back to the fast
+  // interval, e.g. after a new call result has been issued.
+  static void Wake();
+  static Stats GetStats();
+
+  // Main thread only, and no-ops while the dispatcher isn't running.
+  static void RegisterCallback(CCallbackBase* callback);
+  static void UnregisterCallback(CCallbackBase* callback);
+  static void RegisterCallResult(CCallbackBase* call_result,
+                                 SteamAPICall_t api_call);
+  static void UnregisterCallResult(CCallbackBase* call_result);
+};
+
+}  // namespace greenworks
+
+#endif  // SRC_STEAM_DISPATCHER_H_
@@ -8,8 +8,19 @@
 
 namespace greenworks {
 
-v8::Local<v8::Object> SteamID::Create(CSteamID steam_id) {
+namespace {
+
+// Greenworks is loaded into a single isolate, so one constructor is shared by
+// all SteamID objects.
+Nan::Persistent<v8::Function> g_steam_id_constructor;
+
+}  // namespace
+
+v8::Local<v8::Function> SteamID::GetConstructor() {
   Nan::EscapableHandleScope scope;
+  if (!g_steam_id_constructor.IsEmpty())
+    return scope.Escape(Nan::New(g_steam_id_constructor));
+
   v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>();
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
 
@@ -37,9 +48,16 @@ v8::Local<v8::Object> SteamID::Create(CSteamID steam_id) {
   SetPrototypeMethod(tpl, "getRelationship", GetRelationship);
   SetPrototypeMethod(tpl, "getSteamLevel", GetSteamLevel);
 
+  v8::Local<v8::Function> constructor = Nan::GetFunction(tpl).ToLocalChecked();
+  g_steam_id_constructor.Reset(constructor);
+  return scope.Escape(constructor);
+}
+
+v8::Local<v8::Object> SteamID::Create(CSteamID steam_id) {
+  Nan::EscapableHandleScope scope;
   auto* obj = new SteamID(steam_id);
   v8::Local<v8::Object> instance =
-      Nan::NewInstance(Nan::GetFunction(tpl).ToLocalChecked()).ToLocalChecked();
+      Nan::NewInstance(GetConstructor()).ToLocalChecked();
   Nan::SetInternalFieldPointer(instance, 0, obj);
   return scope.Escape(instance);
 }
@@ -37,6 +37,9 @@ class SteamID : public Nan::ObjectWrap {
   static NAN_METHOD(GetSteamLevel);
 
  private:
+  // Builds the SteamID constructor on first use and caches it.
+  static v8::Local<v8::Function> GetConstructor();
+
   explicit SteamID(CSteamID steam_id) : steam_id_(steam_id) {}
   ~SteamID() override {}
 
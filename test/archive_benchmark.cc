@@ -0,0 +1,555 @@
+// Copyright (c) 2015 Greenheart Games Pty. Ltd. All rights reserved.
+// Use of this source code is governed by the MIT license that can be
+// found in the LICENSE file.
+
+// Measures zip() and unzip() on generated files, without Steam or node.
+// Built by binding.gyp when the `archive_benchmark` gyp variable is set:
+//
+//   GYP_DEFINES="archive_benchmark=1" node-gyp rebuild
+//   build/Release/archive_benchmark [options] [corpus...]
+//
+// Options:
+//   --dir <path>   Where the files are generated, defaults to
+//                  "archive_benchmark.tmp". It is removed afterwards.
+//   --threads <n>  ZipOptions/UnzipOptions::threads, defaults to 1.
+//   --level <n>    Compression level, defaults to 6.
+//   --scale <f>    Multiplies the size of every corpus, defaults to 1.
+//   --keep         Doesn't remove the generated files.
+//
+// Corpora are "tiny" (many small files), "huge" (a few large files), "random"
+// (incompressible data) and "text"; all of them are run by default.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "greenworks_unzip.h"
+#include "greenworks_zip.h"
+
+namespace {
+
+struct Options {
+  Options() : dir("archive_benchmark.tmp"), threads(1), level(6), scale(1),
+              keep(false) {}
+
+  std::string dir;
+  int threads;
+  int level;
+  double scale;
+  bool keep;
+};
+
+// Resource usage of the process at one point in time.
+struct Usage {
+  Usage() : peak_rss(0), has_syscalls(false), syscalls(0), reads(0),
+            writes(0) {}
+
+  uint64_t peak_rss;
+  // Number of system calls of any kind, where they can be counted.
+  bool has_syscalls;
+  uint64_t syscalls;
+  // Number of read and write system calls, 0 where the OS doesn't count them.
+  uint64_t reads;
+  uint64_t writes;
+};
+
+struct Corpus {
+  const char* name;
+  void (*generate)(const std::string& dir, double scale);
+};
+
+// xorshift64*, so that every run generates the same files.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed) {}
+
+  uint64_t Next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 2685821657736338717ULL;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+#if defined(_WIN32)
+const char kSeparator = '\\';
+#else
+const char kSeparator = '/';
+#endif
+
+std::string JoinPath(const std::string& dir, const std::string& name) {
+  return dir + kSeparator + name;
+}
+
+bool MakeDirectory(const std::string& path) {
+#if defined(_WIN32)
+  return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+void RemoveTree(const std::string& path) {
+#if defined(_WIN32)
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(JoinPath(path, "*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE) {
+    DeleteFileA(path.c_str());
+    return;
+  }
+  do {
+    std::string name = data.cFileName;
+    if (name == "." || name == "..")
+      continue;
+    std::string child = JoinPath(path, name);
+    if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      RemoveTree(child);
+    else
+      DeleteFileA(child.c_str());
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+  RemoveDirectoryA(path.c_str());
+#else
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    unlink(path.c_str());
+    return;
+  }
+  while (dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..")
+      continue;
+    std::string child = JoinPath(path, name);
+    struct stat st;
+    if (lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+      RemoveTree(child);
+    else
+      unlink(child.c_str());
+  }
+  closedir(dir);
+  rmdir(path.c_str());
+#endif
+}
+
+bool WriteFile(const std::string& path, const std::string& data) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && ok;
+}
+
+// Appends |size| bytes of words and line breaks to |text|, which deflate
+// shrinks to about a quarter.
+void AppendText(Random* random, size_t size, std::string* text) {
+  static const char* const kWords[] = {
+    "achievement", "steam", "workshop", "cloud", "the", "of", "and", "a",
+    "to", "in", "is", "you", "that", "it", "he", "was", "for", "on", "are",
+    "as", "with", "his", "they", "at", "be", "this", "have", "from", "or",
+    "one", "had", "by", "word", "but", "not", "what", "all", "were", "we",
+    "when", "your", "can", "said", "there", "use", "an", "each", "which",
+    "leaderboard", "lobby", "inventory", "greenworks", "archive", "level",
+  };
+  const size_t word_count = sizeof(kWords) / sizeof(kWords[0]);
+  size_t end = text->size() + size;
+  while (text->size() < end) {
+    uint64_t value = random->Next();
+    text->append(kWords[value % word_count]);
+    text->push_back((value >> 32) % 12 == 0 ? '\n' : ' ');
+  }
+  text->resize(end);
+}
+
+void AppendRandom(Random* random, size_t size, std::string* data) {
+  size_t end = data->size() + size;
+  while (data->size() < end) {
+    uint64_t value = random->Next();
+    data->append(reinterpret_cast<const char*>(&value),
+                 std::min(sizeof(value), end - data->size()));
+  }
+}
+
+size_t Scaled(double size, double scale) {
+  return std::max<size_t>(1, static_cast<size_t>(size * scale));
+}
+
+void GenerateTiny(const std::string& dir, double scale) {
+  Random random(1);
+  size_t files = Scaled(20000, scale);
+  for (size_t i = 0; i < files; ++i) {
+    std::string subdir = JoinPath(dir, std::to_string(i % 100));
+    if (i < 100)
+      MakeDirectory(subdir);
+    std::string text;
+    AppendText(&random, 16 + random.Next() % 2048, &text);
+    WriteFile(JoinPath(subdir, std::to_string(i) + ".txt"), text);
+  }
+}
+
+void GenerateHuge(const std::string& dir, double scale) {
+  Random random(2);
+  const size_t kChunkSize = 16 * 1024 * 1024;
+  for (int i = 0; i < 2; ++i) {
+    FILE* file = fopen(JoinPath(dir, "huge" + std::to_string(i) + ".dat")
+                           .c_str(), "wb");
+    if (file == nullptr)
+      return;
+    // Mostly text with some noise, like game assets tend to be.
+    for (size_t left = Scaled(256 * 1024 * 1024, scale); left > 0;) {
+      size_t size = std::min(left, kChunkSize);
+      std::string data;
+      AppendText(&random, size - size / 8, &data);
+      AppendRandom(&random, size / 8, &data);
+      fwrite(data.data(), 1, data.size(), file);
+      left -= size;
+    }
+    fclose(file);
+  }
+}
+
+void GenerateRandom(const std::string& dir, double scale) {
+  Random random(3);
+  for (int i = 0; i < 16; ++i) {
+    std::string data;
+    AppendRandom(&random, Scaled(4 * 1024 * 1024, scale), &data);
+    WriteFile(JoinPath(dir, "random" + std::to_string(i) + ".bin"), data);
+  }
+}
+
+void GenerateText(const std::string& dir, double scale) {
+  Random random(4);
+  size_t files = Scaled(64, scale);
+  for (size_t i = 0; i < files; ++i) {
+    std::string text;
+    AppendText(&random, 1024 * 1024, &text);
+    WriteFile(JoinPath(dir, "text" + std::to_string(i) + ".txt"), text);
+  }
+}
+
+const Corpus kCorpora[] = {
+  { "tiny", &GenerateTiny },
+  { "huge", &GenerateHuge },
+  { "random", &GenerateRandom },
+  { "text", &GenerateText },
+};
+
+void CountFiles(const std::string& path, uint64_t* files, uint64_t* bytes) {
+#if defined(_WIN32)
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(JoinPath(path, "*").c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    std::string name = data.cFileName;
+    if (name == "." || name == "..")
+      continue;
+    if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      CountFiles(JoinPath(path, name), files, bytes);
+    } else {
+      ++*files;
+      *bytes += (static_cast<uint64_t>(data.nFileSizeHigh) << 32) |
+                data.nFileSizeLow;
+    }
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr)
+    return;
+  while (dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..")
+      continue;
+    std::string child = JoinPath(path, name);
+    struct stat st;
+    if (lstat(child.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode)) {
+      CountFiles(child, files, bytes);
+    } else {
+      ++*files;
+      *bytes += st.st_size;
+    }
+  }
+  closedir(dir);
+#endif
+}
+
+uint64_t FileSize(const std::string& path) {
+#if defined(_WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+    return 0;
+  return (static_cast<uint64_t>(data.nFileSizeHigh) << 32) |
+         data.nFileSizeLow;
+#else
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+#endif
+}
+
+#if defined(__linux__)
+// Reads "<key> <value>" from a /proc file.
+uint64_t ReadProcValue(const char* path, const char* key) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr)
+    return 0;
+  char line[256];
+  size_t key_length = strlen(key);
+  uint64_t value = 0;
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, key, key_length) == 0) {
+      value = strtoull(line + key_length, nullptr, 10);
+      break;
+    }
+  }
+  fclose(file);
+  return value;
+}
+#endif
+
+#if defined(__linux__)
+// Counts every system call of the process, including threads started
+// later, with the raw_syscalls:sys_enter tracepoint. -1 if tracefs isn't
+// mounted or tracepoints aren't accessible (perf_event_paranoid -1 or
+// CAP_PERFMON is needed).
+int g_syscall_counter = -1;
+
+void OpenSyscallCounter() {
+  const char* paths[] = {
+      "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+      "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"};
+  for (const char* path : paths) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+      continue;
+    unsigned long long id = 0;
+    bool found = fscanf(file, "%llu", &id) == 1;
+    fclose(file);
+    if (!found)
+      continue;
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    // Threads add their counts when they exit, which they all have by the
+    // time a zip() or unzip() call returns.
+    attr.inherit = 1;
+    g_syscall_counter = static_cast<int>(
+        syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    return;
+  }
+}
+#else
+void OpenSyscallCounter() {}
+#endif
+
+// Makes the next GetUsage() report the peak RSS since now, where the OS
+// allows it. Elsewhere it is the peak of the whole run so far.
+void ResetPeakRss() {
+#if defined(__linux__)
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (file) {
+    fputs("5", file);
+    fclose(file);
+  }
+#endif
+}
+
+Usage GetUsage() {
+  Usage usage;
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS memory;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)))
+    usage.peak_rss = memory.PeakWorkingSetSize;
+  IO_COUNTERS io;
+  if (GetProcessIoCounters(GetCurrentProcess(), &io)) {
+    usage.reads = io.ReadOperationCount;
+    usage.writes = io.WriteOperationCount;
+  }
+#elif defined(__linux__)
+  usage.peak_rss = ReadProcValue("/proc/self/status", "VmHWM:") * 1024;
+  usage.reads = ReadProcValue("/proc/self/io", "syscr:");
+  usage.writes = ReadProcValue("/proc/self/io", "syscw:");
+  uint64_t syscalls;
+  if (g_syscall_counter >= 0 &&
+      read(g_syscall_counter, &syscalls, sizeof(syscalls)) ==
+          sizeof(syscalls)) {
+    usage.has_syscalls = true;
+    usage.syscalls = syscalls;
+  }
+#else
+  struct rusage rusage;
+  if (getrusage(RUSAGE_SELF, &rusage) == 0) {
+    // Bytes on macOS.
+    usage.peak_rss = rusage.ru_maxrss;
+  }
+#endif
+  return usage;
+}
+
+void PrintHeader() {
+  printf("%-8s %-6s %8s %10s %8s %9s %10s %9s %10s %10s %10s\n", "corpus",
+         "op", "files", "MB", "seconds", "MB/s", "files/s", "peak MB",
+         "syscalls", "reads", "writes");
+}
+
+void PrintResult(const char* corpus, const char* op, uint64_t files,
+                 uint64_t bytes, double seconds, const Usage& before,
+                 const Usage& after) {
+  double mb = bytes / (1024.0 * 1024.0);
+  seconds = std::max(seconds, 1e-9);
+  std::string syscalls = "-";
+  if (before.has_syscalls && after.has_syscalls)
+    syscalls = std::to_string(after.syscalls - before.syscalls);
+  printf("%-8s %-6s %8llu %10.1f %8.2f %9.1f %10.0f %9.1f %10s %10llu "
+         "%10llu\n",
+         corpus, op, static_cast<unsigned long long>(files), mb, seconds,
+         mb / seconds, files / seconds, after.peak_rss / (1024.0 * 1024.0),
+         syscalls.c_str(),
+         static_cast<unsigned long long>(after.reads - before.reads),
+         static_cast<unsigned long long>(after.writes - before.writes));
+}
+
+double Now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool RunCorpus(const Corpus& corpus, const Options& options) {
+  std::string root = JoinPath(options.dir, corpus.name);
+  std::string source = JoinPath(root, "source");
+  std::string archive = JoinPath(root, "archive.zip");
+  std::string target = JoinPath(root, "target");
+  MakeDirectory(root);
+  MakeDirectory(source);
+  MakeDirectory(target);
+  corpus.generate(source, options.scale);
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  CountFiles(source, &files, &bytes);
+
+  greenworks::ZipOptions zip_options;
+  zip_options.compression_level = options.level;
+  zip_options.threads = options.threads;
+  std::string error;
+  ResetPeakRss();
+  Usage before = GetUsage();
+  double start = Now();
+  int result = greenworks::zip(archive.c_str(), source.c_str(), zip_options,
+                               &error);
+  double seconds = Now() - start;
+  Usage after = GetUsage();
+  if (result != 0) {
+    fprintf(stderr, "zip() of %s failed with %d %s\n", corpus.name, result,
+            error.c_str());
+    return false;
+  }
+  PrintResult(corpus.name, "zip", files, bytes, seconds, before, after);
+
+  greenworks::UnzipOptions unzip_options;
+  unzip_options.threads = options.threads;
+  ResetPeakRss();
+  before = GetUsage();
+  start = Now();
+  result = greenworks::unzip(archive.c_str(), target.c_str(), unzip_options);
+  seconds = Now() - start;
+  after = GetUsage();
+  if (result != 0) {
+    fprintf(stderr, "unzip() of %s failed with %d\n", corpus.name, result);
+    return false;
+  }
+  PrintResult(corpus.name, "unzip", files, bytes, seconds, before, after);
+  printf("%-8s ratio  %.1f%%\n", corpus.name,
+         bytes ? 100.0 * FileSize(archive) / bytes : 0.0);
+  fflush(stdout);
+
+  if (!options.keep)
+    RemoveTree(root);
+  return true;
+}
+
+void PrintUsage() {
+  fprintf(stderr,
+          "Usage: archive_benchmark [--dir <path>] [--threads <n>] "
+          "[--level <n>] [--scale <f>] [--keep] [tiny|huge|random|text]...\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  std::vector<const Corpus*> corpora;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--dir" && has_value) {
+      options.dir = argv[++i];
+    } else if (arg == "--threads" && has_value) {
+      options.threads = atoi(argv[++i]);
+    } else if (arg == "--level" && has_value) {
+      options.level = atoi(argv[++i]);
+    } else if (arg == "--scale" && has_value) {
+      options.scale = atof(argv[++i]);
+    } else if (arg == "--keep") {
+      options.keep = true;
+    } else {
+      const Corpus* corpus = nullptr;
+      for (const Corpus& candidate : kCorpora) {
+        if (arg == candidate.name)
+          corpus = &candidate;
+      }
+      if (corpus == nullptr) {
+        PrintUsage();
+        return 1;
+      }
+      corpora.push_back(corpus);
+    }
+  }
+  if (corpora.empty()) {
+    for (const Corpus& corpus : kCorpora)
+      corpora.push_back(&corpus);
+  }
+
+  if (!MakeDirectory(options.dir)) {
+    fprintf(stderr, "Can't create %s\n", options.dir.c_str());
+    return 1;
+  }
+  // Before any thread is started, so that they are all counted.
+  OpenSyscallCounter();
+  printf("threads %d, level %d, scale %g\n", options.threads, options.level,
+         options.scale);
+  PrintHeader();
+  bool ok = true;
+  for (const Corpus* corpus : corpora)
+    ok = RunCorpus(*corpus, options) && ok;
+  if (!options.keep)
+    RemoveTree(options.dir);
+  return ok ? 0 : 1;
+}
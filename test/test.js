@@ -3,14 +3,52 @@
 // found in the LICENSE file.
 
 var assert = require("assert");
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
 var greenworks = require('../greenworks');
 
+function removeRecursive(file_path) {
+  if (fs.lstatSync(file_path).isDirectory()) {
+    fs.readdirSync(file_path).forEach(function(name) {
+      removeRecursive(path.join(file_path, name));
+    });
+    fs.rmdirSync(file_path);
+  } else {
+    fs.unlinkSync(file_path);
+  }
+}
+
 describe('greenworks API', function() {
   if (!greenworks.initAPI()) {
     console.log('An error occured initializing Steam API.');
     process.exit(1);
   }
 
+  // Directories made by makeTempDir(), removed after each test.
+  var temp_dirs = [];
+  afterEach(function() {
+    temp_dirs.forEach(removeRecursive);
+    temp_dirs = [];
+  });
+
+  function makeTempDir() {
+    var dir = fs.mkdtempSync(path.join(os.tmpdir(), 'greenworks_test'));
+    temp_dirs.push(dir);
+    return dir;
+  }
+
+  // Writes |files| to a zip in a new temporary directory, and calls
+  // |callback| with the path of the zip and the directory.
+  function writeTempArchive(files, callback) {
+    greenworks.Utils.createArchiveToBuffer(files, '', 6, function(archive) {
+      var dir = makeTempDir();
+      var zip_file_path = path.join(dir, 'test.zip');
+      fs.writeFileSync(zip_file_path, archive);
+      callback(zip_file_path, dir);
+    }, function(err) { throw err; });
+  }
+
   describe('saveTextToFile', function() {
     it('Should save successfully.', function(done) {
       greenworks.saveTextToFile('test_file.txt', 'test_content',
@@ -97,4 +135,131 @@ describe('greenworks API', function() {
       done();
     });
   });
+
+  describe('getFriendsSnapshot', function() {
+    it('Should get successfully', function(done) {
+      var flag = greenworks.FriendFlags['All'];
+      var snapshot = greenworks.getFriendsSnapshot(flag);
+      assert.equal(snapshot.count, greenworks.getFriendCount(flag));
+      assert.equal(snapshot.ids.length, snapshot.count);
+      assert.equal(snapshot.personaStates.length, snapshot.count);
+      assert.equal(snapshot.nameOffsets.length, snapshot.count + 1);
+      assert.equal(snapshot.nameOffsets[snapshot.count], snapshot.names.length);
+      done();
+    });
+  });
+
+  describe('createArchiveToBuffer&extractArchiveFromBuffer', function() {
+    it('Should round-trip successfully', function(done) {
+      var files = [{ name: 'a.txt', data: 'test_content' },
+                   { name: 'dir/b.bin', data: Buffer.from([0, 1, 2, 255]) }];
+      greenworks.Utils.createArchiveToBuffer(files, '', 6, function(archive) {
+        assert(Buffer.isBuffer(archive));
+        greenworks.Utils.extractArchiveFromBuffer(archive, '',
+            function(extracted) {
+          assert.equal(extracted.length, 2);
+          assert.equal(extracted[0].name, 'a.txt');
+          assert.equal(extracted[0].data.toString(), 'test_content');
+          assert.equal(extracted[1].name, 'dir/b.bin');
+          assert(extracted[1].data.equals(files[1].data));
+          done();
+        }, function(err) { throw err; });
+      }, function(err) { throw err; });
+    });
+  });
+
+  describe('openArchive&readEntry', function() {
+    it('Should read an entry successfully', function(done) {
+      var files = [{ name: 'a.txt', data: 'test_content' },
+                   { name: 'manifest.json', data: '{}' }];
+      writeTempArchive(files, function(zip_file_path) {
+        greenworks.Utils.openArchive(zip_file_path, '', function(handle) {
+          assert.equal(handle.getEntryCount(), 2);
+          assert(handle.hasEntry('manifest.json'));
+          greenworks.Utils.readEntry(handle, 'manifest.json', function(data) {
+            assert.equal(data.toString(), '{}');
+            handle.close();
+            done();
+          }, function(err) { throw err; });
+        }, function(err) { throw err; });
+      });
+    });
+  });
+
+  describe('listArchive', function() {
+    it('Should list entries successfully', function(done) {
+      var files = [{ name: 'a.txt', data: 'test_content' },
+                   { name: 'dir/b.txt', data: '' }];
+      writeTempArchive(files, function(zip_file_path) {
+        greenworks.Utils.listArchive(zip_file_path, function(entries) {
+          assert.equal(entries.count, 2);
+          assert.equal(entries.names.toString('utf8', entries.nameOffsets[1],
+                                              entries.nameOffsets[2]),
+                       'dir/b.txt');
+          assert.equal(entries.uncompressedSizes[0], 12);
+          assert.equal(entries.uncompressedSizes[1], 0);
+          done();
+        }, function(err) { throw err; });
+      });
+    });
+  });
+
+  describe('verifyArchive', function() {
+    it('Should find no corrupt entries', function(done) {
+      var files = [{ name: 'a.txt', data: 'test_content' },
+                   { name: 'dir/b.txt', data: 'more_content' }];
+      writeTempArchive(files, function(zip_file_path) {
+        greenworks.Utils.verifyArchive(zip_file_path, '', { threads: 2 },
+            function(result) {
+          assert.equal(result.corruptEntries.length, 0);
+          assert.equal(result.bytes, 24);
+          done();
+        }, function(err) { throw err; });
+      });
+    });
+  });
+
+  describe('createArchive progress', function() {
+    it('Should report the finished entries', function(done) {
+      var source_dir = path.join(makeTempDir(), 'source');
+      fs.mkdirSync(source_dir);
+      fs.writeFileSync(path.join(source_dir, 'a.txt'), 'test_content');
+      fs.writeFileSync(path.join(source_dir, 'b.txt'), 'more_content');
+      var last = null;
+      var handle = greenworks.Utils.createArchive(source_dir + '.zip',
+          source_dir, '', 6, { progress: function(progress) { last = progress; } },
+          function(report) {
+        assert.equal(report.entries.length, 0);
+        assert.equal(report.storedBytes, 0);
+        assert.equal(last.entriesDone, 2);
+        assert.equal(last.entryCount, 2);
+        assert.equal(last.totalBytes, 24);
+        assert.equal(last.bytesIn, 24);
+        assert(last.bytesOut > 0);
+        done();
+      }, function(err) { throw err; });
+      assert.equal(typeof handle.cancel, 'function');
+    });
+  });
+
+  describe('extractArchive skip_unchanged', function() {
+    it('Should extract into an up to date directory again', function(done) {
+      var files = [{ name: 'a.txt', data: 'test_content' },
+                   { name: 'b.txt', data: 'test_content' }];
+      var options = { skip_unchanged: true, verify_crc: true,
+                      deduplicate: true, verify_duplicates: true };
+      writeTempArchive(files, function(zip_file_path, dir) {
+        var extract_dir = path.join(dir, 'extracted');
+        greenworks.Utils.extractArchive(zip_file_path, extract_dir, '',
+            options, function() {
+          greenworks.Utils.extractArchive(zip_file_path, extract_dir, '',
+              options, function() {
+            assert.equal(fs.readFileSync(path.join(extract_dir, 'b.txt'),
+                                         'utf8'), 'test_content');
+            done();
+          }, function(err) { throw err; });
+        }, function(err) { throw err; });
+      });
+    });
+  });
 });